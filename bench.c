@@ -0,0 +1,392 @@
+// Benchmark harness: runs the exact branch and bound and the restarts plus
+// local search heuristic over every instance convert_augerat.py wrote, each
+// run in a child process of its own so that its peak RSS is its own, and
+// writes one CSV row or JSON object per run with the wall time, search
+// counters and gap to the best known cost of the original A-VRP file.
+//
+// Build: make bench
+// Usage: ./bench [--dir DIR] [--nodes N] [--threads N] [--time-limit S]
+//                [--csv FILE] [--json FILE] [instance ...]
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "branch_bound.h"
+#include "construction.h"
+#include "data_structures.h"
+#include "heuristic.h"
+#include "report.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+typedef struct BenchConfig {
+  const char *dir;
+  int n_iter;
+  unsigned int n_threads;
+  double time_limit;
+} BenchConfig;
+
+// What a child process sends back about its run
+typedef struct BenchReport {
+  bool solved;
+  unsigned int n;
+  double cost;
+  double seconds;
+  SearchStats stats;
+} BenchReport;
+
+typedef struct BenchRun {
+  const char *instance;
+  const char *algorithm;
+  bool ok;
+  BenchReport report;
+  double best_known;
+  long peak_rss_kb;
+} BenchRun;
+
+typedef Solution *(*BenchSolver)(Graph *g, Fleet *c, Vertice *origin,
+                                 BenchConfig *cfg, SearchOptions *o);
+
+static Solution *solve_branch_bound(Graph *g, Fleet *c, Vertice *origin,
+                                    BenchConfig *cfg, SearchOptions *o) {
+  return branch_bound_vrp_solve_with(g, c, origin, cfg->n_iter, 0, o);
+}
+
+static Solution *solve_heuristic(Graph *g, Fleet *c, Vertice *origin,
+                                 BenchConfig *cfg, SearchOptions *o) {
+  return heuristic_vrp_solve(g, c, origin, cfg->n_iter, cfg->time_limit, o);
+}
+
+static const struct {
+  const char *name;
+  BenchSolver solve;
+} algorithms[] = {
+  {"branch_bound", solve_branch_bound},
+  {"heuristic", solve_heuristic}
+};
+
+static bool has_suffix(const char *s, const char *suffix) {
+  size_t n = strlen(s), m = strlen(suffix);
+  return n >= m && !strcmp(s + n - m, suffix);
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// ===========================================================================
+//                                  INSTANCES
+// ===========================================================================
+
+// The converted instances in dir, sorted. An instance converted to both
+// formats is run once, from its binary file.
+static char **list_instances(const char *dir, unsigned int *n_instances) {
+  DIR *d = opendir(dir);
+  struct dirent *entry;
+  char **names = NULL, *path;
+  unsigned int n = 0, i;
+  size_t length;
+
+  *n_instances = 0;
+  if (!d) return NULL;
+  while ((entry = readdir(d))) {
+    if (!has_suffix(entry->d_name, ".vrpb") &&
+        !has_suffix(entry->d_name, ".vrpt")) {
+      continue;
+    }
+    length = strlen(dir) + strlen(entry->d_name) + 2;
+    path = malloc(length);
+    snprintf(path, length, "%s/%s", dir, entry->d_name);
+    names = realloc(names, (n + 1)*sizeof(char *));
+    names[n++] = path;
+  }
+  closedir(d);
+  qsort(names, n, sizeof(char *), compare_names);
+
+  // Sorted, a .vrpt file directly follows the .vrpb file of its instance
+  for (i = 0; i < n; i++) {
+    length = strlen(names[i]);
+    if (*n_instances && has_suffix(names[i], ".vrpt") &&
+        !strncmp(names[*n_instances - 1], names[i], length - 1)) {
+      free(names[i]);
+      continue;
+    }
+    names[(*n_instances)++] = names[i];
+  }
+  return names;
+}
+
+// The optimal or best value in the COMMENT line of a CVRPLIB file, as the
+// A-VRP files give it, or NAN
+static double read_best_known(const char *filename) {
+  FILE *f = fopen(filename, "r");
+  char line[512], *it;
+  double best = NAN;
+
+  if (!f) return NAN;
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, "COMMENT", 7)) continue;
+    it = strstr(line, "Optimal value:");
+    if (!it) it = strstr(line, "Best value:");
+    if (it) best = strtod(strchr(it, ':') + 1, NULL);
+    break;
+  }
+  fclose(f);
+  return best;
+}
+
+// Converted instances are named after their A-VRP file, with a t or b added
+static double best_known_cost(const char *dir, const char *instance) {
+  const char *name = strrchr(instance, '/');
+  char filename[1024];
+  int length;
+
+  name = name ? name + 1 : instance;
+  if (has_suffix(name, ".vrp")) return read_best_known(instance);
+  length = (int)strlen(name) - 1;
+  snprintf(filename, sizeof(filename), "%s/A-VRP/%.*s", dir, length, name);
+  return read_best_known(filename);
+}
+
+// ===========================================================================
+//                                    RUNS
+// ===========================================================================
+
+// Runs in the child: solves the instance as main does by default, with a
+// constructed warm start, and writes a BenchReport to fd
+static void bench_child(const char *instance, BenchSolver solve,
+                        BenchConfig *cfg, int fd) {
+  BenchReport report;
+  SearchOptions options;
+  Instance *inst = malloc(sizeof(Instance));
+  Solution *s;
+  struct timespec start;
+
+  // The CSV may go to stdout, and the report goes through the pipe
+  set_log_level(LOG_NONE);
+  if (!read_instance(inst, instance)) exit(1);
+
+  memset(&report, 0, sizeof(report));
+  init_search_options(&options);
+  options.n_threads = cfg->n_threads;
+  options.stats = &report.stats;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  options.warm_start = construct_solution(inst->g, inst->vehicles,
+                                          inst->vertices[0]);
+  s = solve(inst->g, inst->vehicles, inst->vertices[0], cfg, &options);
+  report.seconds = seconds_since(&start);
+  report.n = inst->g->n;
+  report.solved = s != NULL;
+  report.cost = s ? s->cost : NAN;
+
+  if (write(fd, &report, sizeof(report)) != sizeof(report)) exit(1);
+  destroy_solution(s);
+  destroy_solution(options.warm_start);
+  destroy_instance(inst);
+  exit(0);
+}
+
+static void bench_run(BenchRun *run, BenchSolver solve, BenchConfig *cfg) {
+  int fd[2], status;
+  pid_t pid;
+  struct rusage usage;
+
+  run->ok = false;
+  run->peak_rss_kb = 0;
+  memset(&run->report, 0, sizeof(BenchReport));
+  run->best_known = best_known_cost(cfg->dir, run->instance);
+
+  fflush(stdout);
+  if (pipe(fd)) return;
+  pid = fork();
+  if (pid < 0) {
+    close(fd[0]);
+    close(fd[1]);
+    return;
+  }
+  if (!pid) {
+    close(fd[0]);
+    bench_child(run->instance, solve, cfg, fd[1]);
+  }
+
+  close(fd[1]);
+  run->ok = read(fd[0], &run->report, sizeof(BenchReport)) ==
+            sizeof(BenchReport);
+  close(fd[0]);
+  if (wait4(pid, &status, 0, &usage) != pid) {
+    run->ok = false;
+    return;
+  }
+  run->ok = run->ok && WIFEXITED(status) && !WEXITSTATUS(status);
+  // Linux reports kilobytes
+  run->peak_rss_kb = usage.ru_maxrss;
+}
+
+// ===========================================================================
+//                                   OUTPUT
+// ===========================================================================
+
+static const char *run_status(BenchRun *run) {
+  if (!run->ok) return "failed";
+  return run->report.solved ? "solved" : "no_solution";
+}
+
+static double run_gap(BenchRun *run) {
+  if (!run->ok || !run->report.solved || isnan(run->best_known)) return NAN;
+  return 100*(run->report.cost - run->best_known) / run->best_known;
+}
+
+static void print_csv_number(FILE *f, double value) {
+  if (!isnan(value)) fprintf(f, "%f", value);
+}
+
+static void write_csv(FILE *f, BenchRun *runs, unsigned int n_runs) {
+  unsigned int i;
+  BenchRun *run;
+
+  fprintf(f, "version,instance,n,algorithm,status,cost,best_known,gap_percent,"
+             "seconds,nodes,pruned_bound,pruned_capacity,pruned_connectivity,"
+             "peak_rss_kb\n");
+  for (i = 0; i < n_runs; i++) {
+    run = &runs[i];
+    fprintf(f, "%s,%s,%u,%s,%s,", BENCH_VERSION, run->instance, run->report.n,
+            run->algorithm, run_status(run));
+    print_csv_number(f, run->report.solved ? run->report.cost : NAN);
+    fprintf(f, ",");
+    print_csv_number(f, run->best_known);
+    fprintf(f, ",");
+    print_csv_number(f, run_gap(run));
+    fprintf(f, ",%.6f,%lu,%lu,%lu,%lu,%ld\n", run->report.seconds,
+            run->report.stats.nodes, run->report.stats.pruned_bound,
+            run->report.stats.pruned_capacity,
+            run->report.stats.pruned_connectivity, run->peak_rss_kb);
+  }
+}
+
+static void print_json_number(FILE *f, const char *key, double value) {
+  if (isnan(value)) fprintf(f, "\"%s\": null, ", key);
+  else fprintf(f, "\"%s\": %f, ", key, value);
+}
+
+static void write_json(FILE *f, BenchRun *runs, unsigned int n_runs) {
+  unsigned int i;
+  BenchRun *run;
+
+  fprintf(f, "[\n");
+  for (i = 0; i < n_runs; i++) {
+    run = &runs[i];
+    fprintf(f, "  {\"version\": \"%s\", \"instance\": \"%s\", \"n\": %u, "
+               "\"algorithm\": \"%s\", \"status\": \"%s\", ",
+            BENCH_VERSION, run->instance, run->report.n, run->algorithm,
+            run_status(run));
+    print_json_number(f, "cost", run->report.solved ? run->report.cost : NAN);
+    print_json_number(f, "best_known", run->best_known);
+    print_json_number(f, "gap_percent", run_gap(run));
+    fprintf(f, "\"seconds\": %.6f, \"nodes\": %lu, \"pruned_bound\": %lu, "
+               "\"pruned_capacity\": %lu, \"pruned_connectivity\": %lu, "
+               "\"peak_rss_kb\": %ld}%s\n",
+            run->report.seconds, run->report.stats.nodes,
+            run->report.stats.pruned_bound, run->report.stats.pruned_capacity,
+            run->report.stats.pruned_connectivity, run->peak_rss_kb,
+            i + 1 < n_runs ? "," : "");
+  }
+  fprintf(f, "]\n");
+}
+
+static bool write_report(const char *filename, BenchRun *runs,
+                         unsigned int n_runs, bool json) {
+  FILE *f = fopen(filename, "w");
+  if (!f) {
+    fprintf(stderr, "ERROR: Could not write %s.\n", filename);
+    return false;
+  }
+  if (json) write_json(f, runs, n_runs);
+  else write_csv(f, runs, n_runs);
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char const *argv[]) {
+  int i;
+  unsigned int j, k, n_instances = 0, n_runs = 0;
+  unsigned int n_algorithms = sizeof(algorithms)/sizeof(algorithms[0]);
+  const char *csv = NULL, *json = NULL;
+  char **instances = NULL;
+  bool ok = true;
+  BenchConfig cfg;
+  BenchRun *runs;
+
+  cfg.dir = "instances";
+  cfg.n_iter = 100000;
+  cfg.n_threads = 1;
+  cfg.time_limit = 0;
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--dir") && i+1 < argc) {
+      cfg.dir = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--nodes") && i+1 < argc) {
+      cfg.n_iter = atoi(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--threads") && i+1 < argc) {
+      cfg.n_threads = atoi(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--time-limit") && i+1 < argc) {
+      cfg.time_limit = atof(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--csv") && i+1 < argc) {
+      csv = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--json") && i+1 < argc) {
+      json = argv[++i];
+    }
+    else {
+      instances = realloc(instances, (n_instances + 1)*sizeof(char *));
+      instances[n_instances++] = strdup(argv[i]);
+    }
+  }
+  if (!n_instances) {
+    instances = list_instances(cfg.dir, &n_instances);
+  }
+  if (!n_instances) {
+    fprintf(stderr, "ERROR: No instances in %s, run convert_augerat.py.\n",
+            cfg.dir);
+    return 1;
+  }
+
+  runs = calloc(n_instances*n_algorithms, sizeof(BenchRun));
+  for (j = 0; j < n_instances; j++) {
+    for (k = 0; k < n_algorithms; k++) {
+      runs[n_runs].instance = instances[j];
+      runs[n_runs].algorithm = algorithms[k].name;
+      bench_run(&runs[n_runs], algorithms[k].solve, &cfg);
+      fprintf(stderr, "%s %s: %s in %.3f s\n", instances[j],
+              algorithms[k].name, run_status(&runs[n_runs]),
+              runs[n_runs].report.seconds);
+      n_runs++;
+    }
+  }
+
+  if (csv) ok = write_report(csv, runs, n_runs, false);
+  else write_csv(stdout, runs, n_runs);
+  if (json) ok = write_report(json, runs, n_runs, true) && ok;
+
+  for (j = 0; j < n_instances; j++) {
+    free(instances[j]);
+  }
+  free(instances);
+  free(runs);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+// Microbenchmark for the exclude-branch feasibility test: compares the
+// legacy strongly_connected (one BFS plus one path search per customer),
+// extended to the end of the route being built, against residual_connected
+// on search states sampled from random dives.
+//
+// Build: make bench_connectivity
+// Usage: ./bench_connectivity <samples> <instance> [instance ...]
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "data_structures.h"
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+  return (end->tv_sec - start->tv_sec)*1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static Edge *first_allowed_edge(Graph *g, Tree *t) {
+  unsigned int i, degree = degree_out(g, t->current_v->id);
+  Edge **out_edges = edges_out(g, t->current_v->id);
+  for (i = 0; i < degree; i++) {
+    if (edge_ignored(t, edge_id(g, out_edges[i]))) continue;
+    if (bitset_test(t->visited, out_edges[i]->dest->id)) continue;
+    return out_edges[i];
+  }
+  return NULL;
+}
+
+static bool all_marked(bool *mark, unsigned int n) {
+  unsigned int i;
+  for (i = 0; i < n; i++) {
+    if (!mark[i]) return false;
+  }
+  return true;
+}
+
+// strongly_connected, but also reaching the customers left from the end of
+// the route being built, as the route may still visit them before it
+// returns to the depot
+static bool route_connected(Graph *g, Tree *t, Edge *e, Vertice *origin,
+                            Workspace *w) {
+  unsigned int i;
+  bool *mark = w->mark, *smark = w->smark;
+
+  memset(mark, 0, g->n*sizeof(bool));
+  memset(smark, 0, g->n*sizeof(bool));
+
+  smark[origin->id] = true;
+  for (i = 0; i < g->n; i++) {
+    if (bitset_test(t->visited, i) && i != e->dest->id) {
+      mark[i] = true;
+      smark[i] = true;
+    }
+  }
+
+  bfs(g, t, e, origin, smark, w);
+  if (t->current_v != origin) bfs(g, t, e, t->current_v, smark, w);
+  if (!all_marked(smark, g->n)) return false;
+
+  for (i = 0; i < g->n; i++) {
+    if (i != origin->id && !bitset_test(t->visited, i)) {
+      path(g, t, e, g->v[i], origin, mark, w);
+    }
+  }
+  return all_marked(mark, g->n);
+}
+
+static void bench_instance(const char *filename, unsigned int samples) {
+  unsigned int i, n_samples = 0, mismatches = 0, route_only = 0;
+  bool *expected;
+  double old_ns, cold_ns, warm_ns;
+  struct timespec start, end;
+  Tree **nodes, *t, *child;
+  Edge **edges, *e;
+  Workspace *w;
+  TreePool *pool;
+  Instance *inst = malloc(sizeof(Instance));
+  Vertice *origin;
+
+  if (!read_instance(inst, filename)) {
+    printf("%s: could not read instance\n", filename);
+    free(inst);
+    return;
+  }
+  origin = inst->vertices[0];
+
+  w = malloc(sizeof(Workspace));
+  init_workspace(w, inst->g, inst->vehicles);
+  pool = malloc(sizeof(TreePool));
+  init_tree_pool(pool, inst->g, inst->vehicles, 2*samples + 1);
+  nodes = calloc(samples, sizeof(Tree *));
+  edges = calloc(samples, sizeof(Edge *));
+  expected = calloc(samples, sizeof(bool));
+
+  // Random dives, branching left or right the same way the solver would
+  srand(1);
+  t = NULL;
+  while (n_samples < samples) {
+    if (!t) {
+      t = pool_get_tree(pool);
+      init_tree(t, origin, NULL, false, NULL, inst->vehicles, origin, inst->g);
+    }
+    e = first_allowed_edge(inst->g, t);
+    if (!e) {
+      t = NULL;
+      continue;
+    }
+    nodes[n_samples] = t;
+    edges[n_samples] = e;
+    expected[n_samples] = route_connected(inst->g, t, e, origin, w);
+    // States only the route being built can still complete
+    if (expected[n_samples] && !strongly_connected(inst->g, t, e, origin, w)) {
+      route_only++;
+    }
+    n_samples++;
+
+    child = pool_get_tree(pool);
+    if (rand() % 2 || !expected[n_samples-1]) {
+      init_tree_from_parent(child, t, e->dest, e, true, origin, inst->g);
+    }
+    else {
+      init_tree_from_parent(child, t, e->origin, e, false, origin, inst->g);
+    }
+    t = child;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < n_samples; i++) {
+    route_connected(inst->g, nodes[i], edges[i], origin, w);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  old_ns = elapsed_ns(&start, &end) / n_samples;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < n_samples; i++) {
+    nodes[i]->residual_known = false;
+    residual_connected(inst->g, nodes[i], edges[i], origin, w);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  cold_ns = elapsed_ns(&start, &end) / n_samples;
+
+  // Replay with the per-node cache as the search sees it
+  for (i = 0; i < n_samples; i++) {
+    nodes[i]->residual_known = false;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < n_samples; i++) {
+    if (residual_connected(inst->g, nodes[i], edges[i], origin, w) !=
+        expected[i]) {
+      mismatches++;
+    }
+    // Hand the answer down the way init_tree_from_parent does
+    child = i+1 < n_samples ? nodes[i+1] : NULL;
+    if (child && child->parent == nodes[i] && !child->edge_value &&
+        edges[i]->origin != origin) {
+      child->residual_known = nodes[i]->residual_known;
+      child->residual_ok = nodes[i]->residual_ok;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  warm_ns = elapsed_ns(&start, &end) / n_samples;
+
+  printf("%-32s %4u %8u %8u %12.1f %12.1f %12.1f %8.1fx %6u\n", filename,
+         inst->n, n_samples, route_only, old_ns, cold_ns, warm_ns,
+         old_ns / warm_ns, mismatches);
+
+  free(nodes);
+  free(edges);
+  free(expected);
+  destroy_tree_pool(pool);
+  destroy_workspace(w);
+  destroy_instance(inst);
+}
+
+int main(int argc, char const *argv[]) {
+  int i;
+
+  if (argc < 3) {
+    printf("ERROR: Please specify sample count and at least one instance.");
+    return 1;
+  }
+
+  printf("%-32s %4s %8s %8s %12s %12s %12s %9s %6s\n", "instance", "n",
+         "samples", "route", "old ns", "new cold ns", "new ns", "speedup",
+         "diff");
+  for (i = 2; i < argc; i++) {
+    bench_instance(argv[i], atoi(argv[1]));
+  }
+
+  return 0;
+}
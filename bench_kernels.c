@@ -0,0 +1,88 @@
+// Microbenchmark for the masked row sums behind the greedy bounds: times
+// every kernel the CPU runs over random rows of growing length, half of
+// them with a chosen out edge, and checks that they give the scalar one's
+// sums bit for bit.
+//
+// Build: gcc -O2 -o bench_kernels bench_kernels.c row_kernels.c -lm
+// Usage: ./bench_kernels [calls]
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "row_kernels.h"
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+  return (end->tv_sec - start->tv_sec)*1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static double random_cost(void) {
+  return 1 + 99.0*rand()/RAND_MAX;
+}
+
+// Whether a kernel added the same numbers in the same order as the scalar
+// one, which is what keeps the search's bounds and pruning unchanged
+static bool same_bits(double a, double b) {
+  return !memcmp(&a, &b, sizeof(double));
+}
+
+// Returns the number of kernels whose sums differ from the scalar ones
+static unsigned int bench_length(unsigned int n, unsigned int calls) {
+  double *chosen = malloc(n*sizeof(double));
+  double *cheapest = malloc(n*sizeof(double));
+  double *dearest = malloc(n*sizeof(double));
+  double lower, upper, want_lower, want_upper, ns, sink = 0;
+  struct timespec start, end;
+  const RowKernel *k;
+  unsigned int i, c, diffs = 0;
+  bool same;
+
+  for (i = 0; i < n; i++) {
+    chosen[i] = rand() % 2 ? random_cost() : 0;
+    cheapest[i] = random_cost();
+    dearest[i] = cheapest[i] + random_cost();
+  }
+  row_kernels[0].masked_sums(chosen, cheapest, dearest, n, &want_lower,
+                             &want_upper);
+
+  for (k = row_kernels; k < row_kernels + n_row_kernels; k++) {
+    if (!k->supported()) continue;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (c = 0; c < calls; c++) {
+      k->masked_sums(chosen, cheapest, dearest, n, &lower, &upper);
+      sink += lower;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = elapsed_ns(&start, &end) / calls;
+    same = same_bits(lower, want_lower) && same_bits(upper, want_upper);
+    diffs += !same;
+    printf("%6u %-8s %12.1f %12.3f %8s\n", n, k->name, ns, n / ns,
+           same ? "ok" : "DIFF");
+  }
+  // Keeps the timed calls from being optimised away
+  if (sink < 0) printf("%f\n", sink);
+
+  free(chosen);
+  free(cheapest);
+  free(dearest);
+  return diffs;
+}
+
+int main(int argc, char const *argv[]) {
+  unsigned int n, diffs = 0, calls = argc > 1 ? atoi(argv[1]) : 1000000;
+
+  srand(1);
+  printf("dispatch: %s\n", best_row_kernel()->name);
+  printf("%6s %-8s %12s %12s %8s\n", "rows", "kernel", "ns/call",
+         "rows/ns", "check");
+  for (n = 8; n <= 4096; n *= 2) {
+    // About the same number of rows summed at every length
+    diffs += bench_length(n, calls > n/8 ? calls/(n/8) : 1);
+    diffs += bench_length(n + 3, calls > n/8 ? calls/(n/8) : 1);
+  }
+
+  return diffs > 0;
+}
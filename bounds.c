@@ -0,0 +1,451 @@
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bounds.h"
+
+#define UNASSIGNED UINT_MAX
+// Subgradient steps for the depot tree: many from zero multipliers at the
+// root, a few per node once the parent's multipliers are close
+#define KTREE_ROOT_STEPS 60
+#define KTREE_NODE_STEPS 4
+
+// ===========================================================================
+//                              RESIDUAL PROBLEM
+// ===========================================================================
+
+static bool out_allowed(Tree *t, Graph *g, unsigned int i, unsigned int j) {
+  unsigned int id = i*g->n + j;
+  return i != j && !edge_ignored(t, id);
+}
+
+// Lists the unvisited customers followed by the depot, returning the count
+static unsigned int residual_vertices(Tree *t, Graph *g, Vertice *origin,
+                                      unsigned int *members) {
+  unsigned int i, k = 0;
+  for (i = 0; i < g->n; i++) {
+    if (i != origin->id && !bitset_test(t->visited, i)) {
+      members[k++] = i;
+    }
+  }
+  members[k++] = origin->id;
+  return k;
+}
+
+static void raise_lower_bound(Tree *t, double bound) {
+  if (bound > t->lower_bound) {
+    t->lower_bound = bound;
+  }
+}
+
+// ===========================================================================
+//                               GREEDY BOUND
+// ===========================================================================
+
+// init_tree already computes this bound, so the engine has no hooks
+const BoundEngine greedy_bound = {"greedy", NULL, NULL};
+
+// ===========================================================================
+//                              ASSIGNMENT BOUND
+// ===========================================================================
+
+// Every unvisited customer and the current vertex (a row) still needs an out
+// edge, towards an unvisited customer or the depot (a column). Customers
+// take one edge in, the depot any number, so the cheapest such assignment
+// plus the cost so far bounds every completion. duals holds the row
+// potentials followed by the column potentials, assign the column of each
+// row. Columns index w->owner by vertex id, with column n as the virtual
+// start of an augmenting path.
+
+// Moves the free row r onto a free column along a shortest augmenting path
+// in reduced costs, keeping the duals feasible. Returns false when no
+// column is reachable.
+static bool augment_row(Tree *t, Graph *g, Vertice *origin, unsigned int r,
+                        unsigned int *cols, unsigned int n_cols,
+                        Workspace *w) {
+  unsigned int k, j, j0 = g->n, j1, i0, row, depot = origin->id;
+  unsigned int *way = w->link, *owner = w->owner;
+  double *u = t->duals, *v = t->duals + g->n, *minv = w->slack;
+  double delta, reduced;
+  bool *used = w->done;
+
+  for (k = 0; k < n_cols; k++) {
+    minv[cols[k]] = INFINITY;
+    used[cols[k]] = false;
+  }
+  owner[g->n] = r;
+
+  // The depot is never full, so reaching it always ends the path
+  do {
+    if (j0 != g->n) used[j0] = true;
+    i0 = owner[j0];
+    delta = INFINITY;
+    j1 = UNASSIGNED;
+    for (k = 0; k < n_cols; k++) {
+      j = cols[k];
+      if (used[j]) continue;
+      if (out_allowed(t, g, i0, j)) {
+        reduced = graph_cost(g, i0, j) - u[i0] - v[j];
+        if (reduced < minv[j]) {
+          minv[j] = reduced;
+          way[j] = j0;
+        }
+      }
+      if (minv[j] < delta) {
+        delta = minv[j];
+        j1 = j;
+      }
+    }
+    if (j1 == UNASSIGNED) return false;
+
+    u[r] += delta;
+    for (k = 0; k < n_cols; k++) {
+      j = cols[k];
+      if (used[j]) {
+        u[owner[j]] += delta;
+        v[j] -= delta;
+      }
+      else {
+        minv[j] -= delta;
+      }
+    }
+    j0 = j1;
+  } while (j0 != depot && owner[j0] != UNASSIGNED);
+
+  while (j0 != g->n) {
+    j1 = way[j0];
+    row = owner[j1];
+    t->assign[row] = j0;
+    if (j0 != depot) owner[j0] = row;
+    j0 = j1;
+  }
+  return true;
+}
+
+// Rows are the customers in cols followed by the current vertex, which
+// solve_assignment stores just past the columns
+static unsigned int row_at(unsigned int *cols, unsigned int n_cols,
+                           unsigned int k) {
+  return cols[k == n_cols - 1 ? n_cols : k];
+}
+
+// A customer column left free by a dropped row must have a zero potential
+// for the assignment to stay optimal. Zeroing it lowers the potentials of
+// the rows it undercuts, and those lose their column in turn. Returns false
+// when some row has no allowed column left.
+static bool restore_slackness(Tree *t, Graph *g, Vertice *origin,
+                              unsigned int *cols, unsigned int n_cols,
+                              unsigned int n_rows, Workspace *w) {
+  unsigned int i, j, k, l;
+  double *u = t->duals, *v = t->duals + g->n, reduced, best;
+  bool changed = true;
+
+  while (changed) {
+    changed = false;
+    for (k = 0; k + 1 < n_cols; k++) {
+      if (w->owner[cols[k]] == UNASSIGNED && v[cols[k]] < 0) {
+        v[cols[k]] = 0;
+        changed = true;
+      }
+    }
+    if (!changed) break;
+
+    for (k = 0; k < n_rows; k++) {
+      i = row_at(cols, n_cols, k);
+      best = INFINITY;
+      for (l = 0; l < n_cols; l++) {
+        if (!out_allowed(t, g, i, cols[l])) continue;
+        reduced = graph_cost(g, i, cols[l]) - v[cols[l]];
+        if (reduced < best) best = reduced;
+      }
+      if (isinf(best)) return false;
+      if (best >= u[i]) continue;
+      u[i] = best;
+      j = t->assign[i];
+      if (j != UNASSIGNED && graph_cost(g, i, j) - u[i] - v[j] > 1e-9) {
+        t->assign[i] = UNASSIGNED;
+        if (j != origin->id) w->owner[j] = UNASSIGNED;
+      }
+    }
+  }
+  return true;
+}
+
+// Completes the assignment of t from whatever rows already hold a column,
+// then raises the lower bound with its cost
+static void solve_assignment(Tree *t, Graph *g, Vertice *origin,
+                             Workspace *w) {
+  unsigned int i, j, k, n_cols, head = t->current_v->id, n_rows;
+  unsigned int *cols = w->members;
+  double total = 0;
+
+  n_cols = residual_vertices(t, g, origin, cols);
+  for (k = 0; k < n_cols; k++) {
+    w->owner[cols[k]] = UNASSIGNED;
+  }
+
+  // Rows are the customers and the current vertex, unless the search sits
+  // at the depot with every customer visited
+  n_rows = n_cols - 1;
+  if (head != origin->id || n_rows > 0) {
+    cols[n_cols] = head;
+    n_rows++;
+  }
+
+  // Drop assignments to columns that are gone or edges that were excluded
+  for (k = 0; k < n_rows; k++) {
+    i = row_at(cols, n_cols, k);
+    j = t->assign[i];
+    if (j == UNASSIGNED) continue;
+    if ((j != origin->id && bitset_test(t->visited, j)) ||
+        !out_allowed(t, g, i, j)) {
+      t->assign[i] = UNASSIGNED;
+    }
+    else if (j != origin->id) {
+      w->owner[j] = i;
+    }
+  }
+
+  if (!restore_slackness(t, g, origin, cols, n_cols, n_rows, w)) {
+    t->lower_bound = INFINITY;
+    return;
+  }
+  for (k = 0; k < n_rows; k++) {
+    i = row_at(cols, n_cols, k);
+    if (t->assign[i] == UNASSIGNED &&
+        !augment_row(t, g, origin, i, cols, n_cols, w)) {
+      t->lower_bound = INFINITY;
+      return;
+    }
+  }
+  // Augmenting paths move earlier rows around, so sum once all are placed
+  for (k = 0; k < n_rows; k++) {
+    i = row_at(cols, n_cols, k);
+    total += graph_cost(g, i, t->assign[i]);
+  }
+
+  raise_lower_bound(t, t->cost_so_far + total);
+}
+
+static void assignment_init(Tree *t, Graph *g, Vertice *origin,
+                            Workspace *w) {
+  unsigned int i;
+  for (i = 0; i < g->n; i++) {
+    t->duals[i] = t->duals[g->n + i] = 0;
+    t->assign[i] = UNASSIGNED;
+  }
+  solve_assignment(t, g, origin, w);
+}
+
+// A child differs from its parent by one decided edge, which frees at most
+// two rows, so repairing the parent's assignment takes one or two
+// augmentations instead of a full solve
+static void assignment_update(Tree *t, Tree *parent, Graph *g,
+                              Vertice *origin, Workspace *w,
+                              double upper_bound) {
+  unsigned int k, n_cols, depot = origin->id;
+  double *v = t->duals + g->n, reduced, best = INFINITY;
+
+  if (isinf(parent->lower_bound)) {
+    t->lower_bound = INFINITY;
+    return;
+  }
+  memcpy(t->duals, parent->duals, 2*g->n*sizeof(double));
+  memcpy(t->assign, parent->assign, g->n*sizeof(unsigned int));
+
+  // Returning to the depot adds it back as a row, with a potential that
+  // keeps its reduced costs non-negative
+  if (t->edge_value && t->current_v == origin &&
+      parent->current_v != origin) {
+    n_cols = residual_vertices(t, g, origin, w->members);
+    for (k = 0; k + 1 < n_cols; k++) {
+      if (!out_allowed(t, g, depot, w->members[k])) continue;
+      reduced = graph_cost(g, depot, w->members[k]) - v[w->members[k]];
+      if (reduced < best) best = reduced;
+    }
+    if (n_cols > 1 && isinf(best)) {
+      t->lower_bound = INFINITY;
+      return;
+    }
+    t->duals[depot] = n_cols > 1 ? best : 0;
+    t->assign[depot] = UNASSIGNED;
+  }
+
+  solve_assignment(t, g, origin, w);
+}
+
+const BoundEngine assignment_bound = {"assignment", assignment_init,
+                                      assignment_update};
+
+// ===========================================================================
+//                               DEPOT TREE BOUND
+// ===========================================================================
+
+// The completion edges connect the depot, the current vertex and the
+// unvisited customers, so they hold a spanning tree of them plus one extra
+// edge per further route. Customers need degree two and the current vertex
+// degree one, which a Lagrangian penalty on every vertex but the depot
+// prices into the edge weights. duals holds the multipliers followed by the
+// best multipliers seen while solving the node.
+
+// Cheapest undirected link between a and b: the current vertex can only
+// leave along its out edges, since it already has its way in
+static double link_cost(Tree *t, Graph *g, Vertice *origin, unsigned int a,
+                        unsigned int b) {
+  unsigned int head = t->current_v->id;
+  double best = INFINITY;
+  if ((b != head || head == origin->id) && out_allowed(t, g, a, b)) {
+    best = graph_cost(g, a, b);
+  }
+  if ((a != head || head == origin->id) && out_allowed(t, g, b, a) &&
+      graph_cost(g, b, a) < best) {
+    best = graph_cost(g, b, a);
+  }
+  return best;
+}
+
+// Weighs the minimum spanning tree under the multipliers, leaving the tree
+// degrees in w->owner. Returns infinity when the residual graph is split.
+static double ktree_pass(Tree *t, Graph *g, Vertice *origin,
+                         unsigned int *members, unsigned int m,
+                         unsigned int n_extra, Workspace *w) {
+  unsigned int a, b, k, x, y, best_k;
+  unsigned int *link = w->link, *degree = w->owner;
+  double *key = w->slack, *pi = t->duals, weight, min_weight = INFINITY;
+  double total = 0;
+  bool *done = w->done;
+
+  for (k = 0; k < m; k++) {
+    key[k] = INFINITY;
+    link[k] = UNASSIGNED;
+    done[k] = false;
+    degree[members[k]] = 0;
+  }
+  // Members end with the depot, the tree grows from there
+  key[m - 1] = 0;
+
+  for (a = 0; a < m; a++) {
+    best_k = UNASSIGNED;
+    for (k = 0; k < m; k++) {
+      if (!done[k] && (best_k == UNASSIGNED || key[k] < key[best_k])) {
+        best_k = k;
+      }
+    }
+    if (isinf(key[best_k])) return INFINITY;
+    done[best_k] = true;
+    total += key[best_k];
+    x = members[best_k];
+    if (link[best_k] != UNASSIGNED) {
+      degree[x]++;
+      degree[members[link[best_k]]]++;
+    }
+
+    for (b = 0; b < m; b++) {
+      if (done[b]) continue;
+      y = members[b];
+      weight = link_cost(t, g, origin, x, y);
+      if (isinf(weight)) continue;
+      weight += pi[x] + pi[y];
+      if (weight < min_weight) min_weight = weight;
+      if (weight < key[b]) {
+        key[b] = weight;
+        link[b] = best_k;
+      }
+    }
+  }
+
+  // Extra edges may weigh less than nothing once penalised
+  if (min_weight < 0) total += n_extra*min_weight;
+  return total;
+}
+
+static void solve_ktree(Tree *t, Graph *g, Vertice *origin, Workspace *w,
+                        double upper_bound, unsigned int steps,
+                        double scale) {
+  unsigned int i, k, s, m, n_customers, target, head = t->current_v->id;
+  unsigned int *members = w->members, *degree = w->owner;
+  double *pi = t->duals, *best_pi = t->duals + g->n, value;
+  double best = -INFINITY, norm, gap, step;
+  int gradient;
+
+  m = residual_vertices(t, g, origin, members);
+  n_customers = m - 1;
+  // The depot stays last, the current vertex joins in front of it
+  if (head != origin->id) {
+    members[m - 1] = head;
+    members[m++] = origin->id;
+  }
+  pi[origin->id] = 0;
+
+  for (s = 0; s < steps; s++) {
+    value = ktree_pass(t, g, origin, members, m, n_customers, w);
+    if (isinf(value)) {
+      t->lower_bound = INFINITY;
+      return;
+    }
+    norm = 0;
+    for (k = 0; k + 1 < m; k++) {
+      i = members[k];
+      target = i == head ? 1 : 2;
+      value -= target*pi[i];
+      gradient = (int)degree[i] - (int)target;
+      norm += gradient*gradient;
+    }
+    if (value > best) {
+      best = value;
+      for (k = 0; k + 1 < m; k++) {
+        best_pi[members[k]] = pi[members[k]];
+      }
+    }
+    if (norm == 0) break;
+
+    // Polyak step towards the best known solution
+    gap = upper_bound - t->cost_so_far - value;
+    if (!(gap > 0) || isinf(gap)) gap = 0.01*fabs(value) + 1;
+    step = scale*gap/norm;
+    for (k = 0; k + 1 < m; k++) {
+      i = members[k];
+      target = i == head ? 1 : 2;
+      pi[i] += step*((int)degree[i] - (int)target);
+    }
+    if (steps > KTREE_NODE_STEPS && (s + 1) % 10 == 0) scale /= 2;
+  }
+
+  // Children start from the multipliers that gave the best bound
+  for (k = 0; k + 1 < m; k++) {
+    pi[members[k]] = best_pi[members[k]];
+  }
+
+  raise_lower_bound(t, t->cost_so_far + best);
+}
+
+static void ktree_init(Tree *t, Graph *g, Vertice *origin, Workspace *w) {
+  memset(t->duals, 0, g->n*sizeof(double));
+  solve_ktree(t, g, origin, w, INFINITY, KTREE_ROOT_STEPS, 2);
+}
+
+static void ktree_update(Tree *t, Tree *parent, Graph *g, Vertice *origin,
+                         Workspace *w, double upper_bound) {
+  if (isinf(parent->lower_bound)) {
+    t->lower_bound = INFINITY;
+    return;
+  }
+  memcpy(t->duals, parent->duals, g->n*sizeof(double));
+  solve_ktree(t, g, origin, w, upper_bound, KTREE_NODE_STEPS, 0.5);
+}
+
+const BoundEngine ktree_bound = {"ktree", ktree_init, ktree_update};
+
+// ===========================================================================
+//                                  ENGINES
+// ===========================================================================
+
+const BoundEngine *find_bound_engine(const char *name) {
+  if (!strcmp(name, greedy_bound.name)) return &greedy_bound;
+  if (!strcmp(name, assignment_bound.name)) return &assignment_bound;
+  if (!strcmp(name, ktree_bound.name)) return &ktree_bound;
+  return NULL;
+}
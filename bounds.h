@@ -0,0 +1,23 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "data_structures.h"
+
+// A lower bound engine tightens t->lower_bound beyond the greedy per-vertex
+// bound that init_tree computes. init solves a node from scratch, update
+// re-solves a child starting from the duals its parent left behind. Both are
+// NULL for an engine that adds nothing to the greedy bound.
+typedef struct BoundEngine {
+  const char *name;
+  void (*init)(Tree *t, Graph *g, Vertice *origin, Workspace *w);
+  void (*update)(Tree *t, Tree *parent, Graph *g, Vertice *origin,
+                 Workspace *w, double upper_bound);
+} BoundEngine;
+
+extern const BoundEngine greedy_bound;
+extern const BoundEngine assignment_bound;
+extern const BoundEngine ktree_bound;
+
+const BoundEngine *find_bound_engine(const char *name);
+
+#endif
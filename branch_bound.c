@@ -0,0 +1,1731 @@
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "branch_bound.h"
+#include "report.h"
+#include "transposition.h"
+
+// Iterations between checks for idle workers waiting on a subtree
+#define DONATE_INTERVAL 64
+// Memory for live nodes under best-first selection when no cap is given
+#define BEST_FIRST_MEMORY ((size_t)512 << 20)
+// Nodes a worker processes between looks at the clock for progress ticks
+#define TICK_NODES 1024
+// Seconds between trace samples when no progress interval is given
+#define TRACE_INTERVAL 0.1
+// One bound evaluation in this many is timed
+#define BOUND_SAMPLE 32
+// Transposition table size when SearchOptions leave it at its default
+#define TABLE_BYTES ((size_t)16 << 20)
+
+typedef struct TaskDeque {
+  pthread_mutex_t lock;
+  Tree **tasks;
+  unsigned int head, tail, size;
+} TaskDeque;
+
+typedef struct Incumbent {
+  pthread_mutex_t lock;
+  Solution *best_solution;
+  _Atomic double best_cost;
+} Incumbent;
+
+typedef struct IncumbentRecord {
+  double cost;
+  double seconds;
+  unsigned long nodes;
+} IncumbentRecord;
+
+typedef struct SearchShared {
+  Graph *g;
+  Fleet *fleet;
+  Vertice *origin;
+  int n_iter;
+  SearchOptions *options;
+  unsigned int max_nodes;
+  struct timespec start;
+  IncumbentRecord *records;
+  unsigned int n_records;
+  Tree *root;
+  unsigned int initial;
+  // Whether routes are searched in one direction only
+  bool orient_routes;
+  // Keys for the workers' transposition tables, if they have any
+  StateKeys keys;
+  bool use_table;
+  double tick_interval;
+  _Atomic double next_progress;
+  unsigned int n_workers;
+  struct Worker *workers;
+  Incumbent *incumbent;
+  atomic_bool found;
+  atomic_uint iterations;
+  atomic_int pending;
+  atomic_uint idle;
+  atomic_bool stop;
+} SearchShared;
+
+typedef struct Worker {
+  unsigned int id;
+  unsigned int seed;
+  pthread_t thread;
+  Workspace *workspace;
+  TaskDeque deque;
+  TranspositionTable table;
+  SearchShared *shared;
+  // Only the owner writes its counters, others read them for progress
+  atomic_ulong nodes;
+  atomic_ulong created;
+  atomic_ulong pruned_bound;
+  atomic_ulong pruned_capacity;
+  atomic_ulong pruned_connectivity;
+  atomic_ulong pruned_symmetry;
+  atomic_ulong pruned_dominance;
+  atomic_ulong table_probes;
+  atomic_ulong table_hits;
+  atomic_ulong connectivity_checks;
+  atomic_ulong bound_evaluations;
+  atomic_ulong bound_ns;
+  atomic_uint max_depth;
+  // The worker's open nodes and their least lower bound, as of its last tick
+  atomic_uint open_nodes;
+  _Atomic double open_bound;
+  unsigned int tick_counter;
+  double next_tick;
+} Worker;
+
+typedef struct HeapEntry {
+  double key;
+  unsigned long seq;
+  Tree *t;
+} HeapEntry;
+
+typedef struct NodeHeap {
+  HeapEntry *entries;
+  unsigned int size, capacity;
+  unsigned long seq;
+} NodeHeap;
+
+typedef struct NodeStack {
+  Tree **nodes;
+  unsigned int size, capacity;
+} NodeStack;
+
+typedef struct RestartPool {
+  Graph *g;
+  Fleet *c;
+  Vertice *origin;
+  int n_iter;
+  SearchOptions *options;
+  unsigned int n_restarts;
+  atomic_uint next;
+  Incumbent *incumbent;
+} RestartPool;
+
+// ===========================================================================
+//                                 TASK DEQUES
+// ===========================================================================
+
+static void init_task_deque(TaskDeque *d) {
+  pthread_mutex_init(&d->lock, NULL);
+  d->size = 16;
+  d->head = d->tail = 0;
+  d->tasks = calloc(d->size, sizeof(Tree *));
+}
+
+static void destroy_task_deque(TaskDeque *d) {
+  while (d->head < d->tail) {
+    destroy_tree(d->tasks[d->head++]);
+  }
+  free(d->tasks);
+  pthread_mutex_destroy(&d->lock);
+}
+
+// The owner pushes and pops at the tail, thieves take the oldest (and
+// usually largest) subtree from the head
+static void push_task(TaskDeque *d, Tree *t) {
+  pthread_mutex_lock(&d->lock);
+  if (d->head == d->tail) {
+    d->head = d->tail = 0;
+  }
+  if (d->tail == d->size) {
+    d->size *= 2;
+    d->tasks = realloc(d->tasks, d->size*sizeof(Tree *));
+  }
+  d->tasks[d->tail++] = t;
+  pthread_mutex_unlock(&d->lock);
+}
+
+static Tree *pop_task(TaskDeque *d) {
+  Tree *t = NULL;
+  pthread_mutex_lock(&d->lock);
+  if (d->head < d->tail) {
+    t = d->tasks[--d->tail];
+  }
+  pthread_mutex_unlock(&d->lock);
+  return t;
+}
+
+static bool task_deque_empty(TaskDeque *d) {
+  bool empty;
+  pthread_mutex_lock(&d->lock);
+  empty = d->head == d->tail;
+  pthread_mutex_unlock(&d->lock);
+  return empty;
+}
+
+static Tree *steal_task(TaskDeque *d) {
+  Tree *t = NULL;
+  pthread_mutex_lock(&d->lock);
+  if (d->head < d->tail) {
+    t = d->tasks[d->head++];
+  }
+  pthread_mutex_unlock(&d->lock);
+  return t;
+}
+
+// ===========================================================================
+//                                  INCUMBENT
+// ===========================================================================
+
+static void init_incumbent(Incumbent *inc) {
+  pthread_mutex_init(&inc->lock, NULL);
+  inc->best_solution = NULL;
+  atomic_init(&inc->best_cost, INFINITY);
+}
+
+// The search only reports solutions cheaper than a warm start, and hands
+// back a copy of it otherwise
+static void seed_incumbent(Incumbent *inc, Solution *warm_start) {
+  if (!warm_start) return;
+  inc->best_solution = copy_solution(warm_start);
+  atomic_store(&inc->best_cost, warm_start->cost);
+}
+
+static void destroy_incumbent(Incumbent *inc) {
+  pthread_mutex_destroy(&inc->lock);
+}
+
+static unsigned long nodes_explored(SearchShared *sh) {
+  unsigned int i;
+  unsigned long nodes = 0;
+  for (i = 0; i < sh->n_workers; i++) {
+    nodes += atomic_load_explicit(&sh->workers[i].nodes, memory_order_relaxed);
+  }
+  return nodes;
+}
+
+// Takes ownership of solution, which becomes the incumbent if it is cheaper
+static void offer_solution(Worker *wk, Solution *solution) {
+  SearchShared *sh = wk->shared;
+  Incumbent *inc = sh->incumbent;
+  IncumbentRecord *record;
+  atomic_store(&sh->found, true);
+
+  pthread_mutex_lock(&inc->lock);
+  if (!inc->best_solution || solution->cost < inc->best_solution->cost) {
+    destroy_solution(inc->best_solution);
+    inc->best_solution = solution;
+    atomic_store(&inc->best_cost, solution->cost);
+
+    sh->records = realloc(sh->records,
+                          (sh->n_records + 1)*sizeof(IncumbentRecord));
+    record = &sh->records[sh->n_records++];
+    record->cost = solution->cost;
+    record->seconds = seconds_since(&sh->start);
+    record->nodes = nodes_explored(sh);
+    if (sh->options->on_incumbent) {
+      sh->options->on_incumbent(solution, record->seconds,
+                                sh->options->incumbent_context);
+    }
+  }
+  else {
+    destroy_solution(solution);
+  }
+  pthread_mutex_unlock(&inc->lock);
+}
+
+static unsigned long read_counter(atomic_ulong *counter) {
+  return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static void collect_search_stats(SearchShared *sh, SearchStats *stats) {
+  unsigned int i, depth;
+  Worker *wk;
+
+  memset(stats, 0, sizeof(SearchStats));
+  for (i = 0; i < sh->n_workers; i++) {
+    wk = &sh->workers[i];
+    stats->nodes += read_counter(&wk->nodes);
+    stats->created += read_counter(&wk->created);
+    stats->pruned_bound += read_counter(&wk->pruned_bound);
+    stats->pruned_capacity += read_counter(&wk->pruned_capacity);
+    stats->pruned_connectivity += read_counter(&wk->pruned_connectivity);
+    stats->pruned_symmetry += read_counter(&wk->pruned_symmetry);
+    stats->pruned_dominance += read_counter(&wk->pruned_dominance);
+    stats->table_probes += read_counter(&wk->table_probes);
+    stats->table_hits += read_counter(&wk->table_hits);
+    stats->connectivity_checks += read_counter(&wk->connectivity_checks);
+    stats->bound_evaluations += read_counter(&wk->bound_evaluations);
+    stats->bound_seconds += read_counter(&wk->bound_ns)*1e-9;
+    depth = atomic_load_explicit(&wk->max_depth, memory_order_relaxed);
+    if (depth > stats->max_depth) stats->max_depth = depth;
+  }
+}
+
+// Adds the counts of one search to the totals of several
+static void accumulate_search_stats(SearchStats *total, SearchStats *stats) {
+  total->nodes += stats->nodes;
+  total->created += stats->created;
+  total->pruned_bound += stats->pruned_bound;
+  total->pruned_capacity += stats->pruned_capacity;
+  total->pruned_connectivity += stats->pruned_connectivity;
+  total->pruned_symmetry += stats->pruned_symmetry;
+  total->pruned_dominance += stats->pruned_dominance;
+  total->table_probes += stats->table_probes;
+  total->table_hits += stats->table_hits;
+  total->connectivity_checks += stats->connectivity_checks;
+  total->bound_evaluations += stats->bound_evaluations;
+  total->bound_seconds += stats->bound_seconds;
+  if (stats->max_depth > total->max_depth) {
+    total->max_depth = stats->max_depth;
+  }
+}
+
+static void print_search_stats(SearchShared *sh, SearchStats *stats) {
+  unsigned int i;
+  if (!log_enabled(LOG_INFO)) return;
+  printf("Nodes explored: %lu in %.3f s\n", stats->nodes,
+         seconds_since(&sh->start));
+  printf("Pruned: %lu by bound, %lu by capacity, %lu by connectivity, "
+         "%lu by symmetry, %lu by dominance\n", stats->pruned_bound,
+         stats->pruned_capacity, stats->pruned_connectivity,
+         stats->pruned_symmetry, stats->pruned_dominance);
+  if (stats->table_probes) {
+    printf("Transposition table: %lu probes, %.1f%% hits\n",
+           stats->table_probes, 100.0*stats->table_hits/stats->table_probes);
+  }
+  printf("Nodes created: %lu, connectivity checks: %lu, max depth: %u\n",
+         stats->created, stats->connectivity_checks, stats->max_depth);
+  printf("Bound evaluations: %lu in about %.3f s\n",
+         stats->bound_evaluations, stats->bound_seconds);
+  for (i = 0; i < sh->n_records; i++) {
+    printf("Incumbent %f found at %.3f s after %lu nodes\n",
+           sh->records[i].cost, sh->records[i].seconds, sh->records[i].nodes);
+  }
+  printf("\n");
+}
+
+// ===========================================================================
+//                                  PROGRESS
+// ===========================================================================
+
+static double microseconds(struct timespec *t) {
+  return t->tv_sec*1e6 + t->tv_nsec*1e-3;
+}
+
+// Returns whether wk should report its open nodes. The clock is only read
+// every TICK_NODES nodes, and never without progress lines or a trace.
+static bool tick_due(Worker *wk) {
+  SearchShared *sh = wk->shared;
+  double now;
+
+  if (sh->tick_interval <= 0 || ++wk->tick_counter % TICK_NODES) {
+    return false;
+  }
+  now = seconds_since(&sh->start);
+  if (now < wk->next_tick) return false;
+  wk->next_tick = now + sh->tick_interval;
+  return true;
+}
+
+// The least lower bound over the open nodes the workers last reported,
+// which no solution left in the search can beat
+static double search_bound(SearchShared *sh) {
+  unsigned int i;
+  double bound = atomic_load(&sh->incumbent->best_cost), open;
+
+  for (i = 0; i < sh->n_workers; i++) {
+    if (!atomic_load_explicit(&sh->workers[i].open_nodes,
+                              memory_order_relaxed)) {
+      continue;
+    }
+    open = atomic_load_explicit(&sh->workers[i].open_bound,
+                                memory_order_relaxed);
+    if (open < bound) bound = open;
+  }
+  return bound;
+}
+
+static void print_progress(SearchShared *sh, double now) {
+  double incumbent = atomic_load(&sh->incumbent->best_cost);
+  double bound = search_bound(sh);
+  unsigned long nodes = nodes_explored(sh);
+  char line[128];
+
+  if (incumbent < INFINITY) {
+    snprintf(line, sizeof(line), "incumbent %f, bound %f, gap %.2f%%",
+             incumbent, bound,
+             incumbent > 0 ? 100*(incumbent - bound)/incumbent : 0);
+  }
+  else {
+    snprintf(line, sizeof(line), "incumbent none, bound %f", bound);
+  }
+  fprintf(stderr, "Progress: %.1f s, %lu nodes, %.0f nodes/s, %s\n", now,
+          nodes, now > 0 ? nodes/now : 0, line);
+}
+
+// Publishes how many nodes wk has open and their least lower bound, samples
+// its counters to the trace, and prints a progress line if wk is the first
+// worker past the time for one
+static void report_tick(Worker *wk, unsigned int open_nodes,
+                        double open_bound) {
+  SearchShared *sh = wk->shared;
+  SearchOptions *o = sh->options;
+  double now = seconds_since(&sh->start), due;
+  struct timespec stamp;
+  char bound[32] = "";
+
+  atomic_store_explicit(&wk->open_nodes, open_nodes, memory_order_relaxed);
+  atomic_store_explicit(&wk->open_bound, open_bound, memory_order_relaxed);
+
+  if (o->trace) {
+    clock_gettime(CLOCK_MONOTONIC, &stamp);
+    if (open_nodes) snprintf(bound, sizeof(bound), ", \"bound\": %f",
+                             open_bound);
+    fprintf(o->trace, ",\n{\"name\": \"worker %u\", \"ph\": \"C\", "
+            "\"ts\": %.0f, \"pid\": %u, \"args\": {\"nodes\": %lu, "
+            "\"open\": %u, \"pruned\": %lu%s}}", wk->id,
+            microseconds(&stamp), sh->initial, read_counter(&wk->nodes),
+            open_nodes, read_counter(&wk->pruned_bound) +
+            read_counter(&wk->pruned_capacity) +
+            read_counter(&wk->pruned_connectivity) +
+            read_counter(&wk->pruned_symmetry) +
+            read_counter(&wk->pruned_dominance), bound);
+  }
+
+  due = atomic_load(&sh->next_progress);
+  if (o->progress_interval > 0 && now >= due &&
+      atomic_compare_exchange_strong(&sh->next_progress, &due,
+                                     now + o->progress_interval)) {
+    print_progress(sh, now);
+  }
+}
+
+// Writes the whole search as one span of the trace
+static void trace_search(SearchShared *sh, SearchStats *stats) {
+  FILE *trace = sh->options->trace;
+  if (!trace) return;
+  fprintf(trace, ",\n{\"name\": \"search %u\", \"ph\": \"X\", "
+          "\"ts\": %.0f, \"dur\": %.0f, \"pid\": %u, \"tid\": 0, "
+          "\"args\": {\"nodes\": %lu, \"max_depth\": %u}}", sh->initial,
+          microseconds(&sh->start), seconds_since(&sh->start)*1e6,
+          sh->initial, stats->nodes, stats->max_depth);
+}
+
+// Counts the open nodes of a depth-first walk of root that is now at
+// current, lowering *bound to their least lower bound: current itself and
+// the untouched right children along the path to it
+static unsigned int open_subtree(Tree *root, Tree *current, double *bound) {
+  unsigned int open = 1;
+  Tree *it = root;
+
+  if (current->lower_bound < *bound) *bound = current->lower_bound;
+  while (it && it != current) {
+    if (it->left_child && it->right_child) {
+      open++;
+      if (it->right_child->lower_bound < *bound) {
+        *bound = it->right_child->lower_bound;
+      }
+    }
+    it = it->left_child ? it->left_child : it->right_child;
+  }
+  return open;
+}
+
+static unsigned int open_tasks(TaskDeque *d, double *bound) {
+  unsigned int i, open;
+
+  pthread_mutex_lock(&d->lock);
+  open = d->tail - d->head;
+  for (i = d->head; i < d->tail; i++) {
+    if (d->tasks[i]->lower_bound < *bound) *bound = d->tasks[i]->lower_bound;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return open;
+}
+
+// ===========================================================================
+//                                   SEARCH
+// ===========================================================================
+
+// Hands the shallowest open subtree of the local tree over to the deque,
+// where idle workers can steal it
+static bool donate_subtree(Worker *wk, Tree *root, Tree *current) {
+  Tree *it = root, *open;
+
+  while (it && it != current) {
+    // Children are visited left first, so a right sibling is still untouched
+    if (it->left_child && it->right_child) {
+      open = it->right_child;
+      it->right_child = NULL;
+      atomic_fetch_add(&wk->shared->pending, 1);
+      push_task(&wk->deque, detach_tree(open));
+      destroy_tree(open);
+      return true;
+    }
+    it = it->left_child ? it->left_child : it->right_child;
+  }
+  return false;
+}
+
+// Only the owner writes its counters, so a relaxed increment does
+static void bump(atomic_ulong *counter, unsigned long by) {
+  atomic_store_explicit(counter, atomic_load_explicit(
+                          counter, memory_order_relaxed) + by,
+                        memory_order_relaxed);
+}
+
+static void note_depth(Worker *wk, unsigned int depth) {
+  if (depth > atomic_load_explicit(&wk->max_depth, memory_order_relaxed)) {
+    atomic_store_explicit(&wk->max_depth, depth, memory_order_relaxed);
+  }
+}
+
+// Runs the bound engine on a new child, timing one evaluation in
+// BOUND_SAMPLE so the clock stays off the hot path
+static void evaluate_bound(Worker *wk, Tree *t, Tree *parent,
+                           double upper_bound) {
+  SearchShared *sh = wk->shared;
+  struct timespec start, end;
+  bool timed = (read_counter(&wk->bound_evaluations) + 1) % BOUND_SAMPLE == 0;
+
+  if (!sh->options->bound->update) return;
+  bump(&wk->bound_evaluations, 1);
+  if (timed) clock_gettime(CLOCK_MONOTONIC, &start);
+  sh->options->bound->update(t, parent, sh->g, sh->origin, wk->workspace,
+                             upper_bound);
+  if (timed) {
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bump(&wk->bound_ns, BOUND_SAMPLE*((end.tv_sec - start.tv_sec)*1000000000UL +
+                                      end.tv_nsec - start.tv_nsec));
+  }
+}
+
+// Lets the bound engine tighten a new child against the parent's duals
+static double tighten_bound(Worker *wk, Tree *t, Tree *parent,
+                            double upper_bound) {
+  evaluate_bound(wk, t, parent, upper_bound);
+  return t->lower_bound;
+}
+
+// Whether including e closes a route the wrong way round. With symmetric
+// costs a route costs the same in both directions, so only the one ending on
+// a larger id than it starts from is searched. Routes need no such rule, as
+// the depot's edges are decided in one order, nor do vehicles of a class,
+// which are only counted.
+static bool symmetric_duplicate(SearchShared *sh, Edge *e,
+                                Vertice *route_first) {
+  return sh->orient_routes && e->dest == sh->origin && route_first &&
+         e->origin != route_first && e->origin->id < route_first->id;
+}
+
+// Folds into the hashes of a node those of its child deciding e, given the
+// edges the node excludes. Excluded edges of the current vertex only matter
+// until it is left, and those of the depot until their customer is visited.
+static void hash_child(SearchShared *sh, uint64_t *excluded, Edge *e,
+                       bool include, uint64_t *state, uint64_t *head) {
+  StateKeys *k = &sh->keys;
+  unsigned int v = e->dest->id;
+
+  if (!include) {
+    if (e->origin == sh->origin) {
+      *state ^= k->depot[v];
+    }
+    else {
+      *head ^= k->head[v];
+    }
+    return;
+  }
+  *head = 0;
+  if (e->dest == sh->origin) return;
+  *state ^= k->visit[v];
+  if (bitset_test(excluded, sh->origin->id*sh->g->n + v)) {
+    *state ^= k->depot[v];
+  }
+}
+
+static void hash_tree(SearchShared *sh, Tree *parent, Tree *child) {
+  if (!sh->use_table) return;
+  hash_child(sh, parent->excluded, child->current_e, child->edge_value,
+             &child->state_hash, &child->head_hash);
+}
+
+// Whether another node in the same state, with the same customers visited,
+// vertex, load, vehicles left and edges it may still take, was reached at no
+// more cost, so that the node cannot lead anywhere cheaper. Otherwise the
+// table remembers the node's cost.
+static bool dominated_state(Worker *wk, uint64_t state, Vertice *current_v,
+                            Vertice *route_first, unsigned int load,
+                            unsigned int *vehicles, double cost,
+                            unsigned int depth) {
+  SearchShared *sh = wk->shared;
+  bool hit, dominated;
+
+  // The route's first customer decides how it may close
+  if (sh->orient_routes && route_first && current_v != sh->origin) {
+    state ^= sh->keys.first[route_first->id];
+  }
+  state = mix_state_key(state ^ sh->keys.current[current_v->id], load,
+                        vehicles, sh->fleet->n_classes);
+  dominated = table_dominated(&wk->table, state, cost, depth, &hit);
+  bump(&wk->table_probes, 1);
+  if (hit) bump(&wk->table_hits, 1);
+  if (dominated) bump(&wk->pruned_dominance, 1);
+  return dominated;
+}
+
+// Processes current: closes its route at the depot, records complete
+// solutions, prunes it by bound, or attaches its children
+static void process_node(Worker *wk, Tree *current) {
+  SearchShared *sh = wk->shared;
+  Graph *g = sh->g;
+  Vertice *origin = sh->origin, *vertice, *v;
+  unsigned int degree, i;
+  int k;
+  Tree *nnode;
+  Edge *edge, **out_edges;
+  Solution *solution;
+  double best_cost;
+
+  bump(&wk->nodes, 1);
+  note_depth(wk, current->level);
+  vertice = current->current_v;
+
+  if (vertice == origin) {
+    k = fleet_best_fit(sh->fleet, current->vehicles,
+                       current->path_demand_so_far);
+    if (k < 0) {
+      bump(&wk->pruned_capacity, 1);
+      return;
+    }
+    // Copy on write: the counts stay shared with the parent until now
+    if (current->vehicles != current->vehicle_counts) {
+      memcpy(current->vehicle_counts, current->vehicles,
+             sh->fleet->n_classes*sizeof(unsigned int));
+      current->vehicles = current->vehicle_counts;
+    }
+    current->vehicles[k]--;
+    current->largest_vehicle = fleet_largest(sh->fleet, current->vehicles);
+    current->path_demand_so_far = 0;
+    if (current->n_vertices_traversed == g->n) {
+      solution = malloc(sizeof(Solution));
+      build_solution(current, solution);
+      offer_solution(wk, solution);
+      return;
+    }
+  }
+
+  // Only the incumbent bounds the search. A node's upper bound assumes a
+  // completion that may not exist, so pruning against it loses solutions,
+  // and which ones depends on the order nodes are reached in.
+  best_cost = atomic_load_explicit(&sh->incumbent->best_cost,
+                                   memory_order_relaxed);
+  if (current->lower_bound >= best_cost) {
+    bump(&wk->pruned_bound, 1);
+    return;
+  }
+  if (sh->use_table &&
+      dominated_state(wk, current->state_hash ^ current->head_hash, vertice,
+                      current->route_first, current->path_demand_so_far,
+                      current->vehicles, current->cost_so_far,
+                      current->level)) {
+    return;
+  }
+
+  out_edges = edges_out(g, vertice->id);
+  degree = degree_out(g, vertice->id);
+  for (i = 0; i < degree; i++) {
+    edge = out_edges[i];
+    if (edge_ignored(current, edge_id(g, edge))) continue;
+    v = edge->dest;
+    if (bitset_test(current->visited, v->id)) continue;
+
+    if (symmetric_duplicate(sh, edge, current->route_first)) {
+      bump(&wk->pruned_symmetry, 1);
+    }
+    else if (current->cost_so_far + edge->cost >= best_cost) {
+      bump(&wk->pruned_bound, 1);
+    }
+    else {
+      nnode = pool_get_tree(wk->workspace->pool);
+      init_tree_from_parent(nnode, current, edge->dest, edge, true, origin, g);
+      hash_tree(sh, current, nnode);
+      if (nnode->path_demand_so_far > nnode->largest_vehicle) {
+        bump(&wk->pruned_capacity, 1);
+        destroy_tree(nnode);
+      }
+      else if (tighten_bound(wk, nnode, current, best_cost) > best_cost) {
+        bump(&wk->pruned_bound, 1);
+        destroy_tree(nnode);
+      }
+      else {
+        add_child_to_parent(current, nnode);
+        bump(&wk->created, 1);
+      }
+    }
+    bump(&wk->connectivity_checks, 1);
+    if (!residual_connected(g, current, edge, origin, wk->workspace)) {
+      bump(&wk->pruned_connectivity, 1);
+    }
+    else {
+      nnode = pool_get_tree(wk->workspace->pool);
+      init_tree_from_parent(nnode, current, edge->origin, edge, false, origin,
+                            g);
+      hash_tree(sh, current, nnode);
+      if (tighten_bound(wk, nnode, current, best_cost) >= best_cost) {
+        bump(&wk->pruned_bound, 1);
+        destroy_tree(nnode);
+      }
+      else {
+        add_child_to_parent(current, nnode);
+        bump(&wk->created, 1);
+      }
+    }
+
+    break;
+  }
+}
+
+// Returns whether the iteration limit or first-solution mode ended the search
+static bool search_stopped(SearchShared *sh) {
+  unsigned int it_counter;
+  if (sh->n_iter > 0) {
+    it_counter = atomic_fetch_add(&sh->iterations, 1) + 1;
+    if (it_counter > (unsigned int)sh->n_iter) {
+      atomic_store(&sh->stop, true);
+    }
+  }
+  else if (sh->n_iter < 0 && atomic_load(&sh->found)) {
+    atomic_store(&sh->stop, true);
+  }
+  return atomic_load_explicit(&sh->stop, memory_order_relaxed);
+}
+
+static void search_subtree(Worker *wk, Tree *root, Tree *current) {
+  SearchShared *sh = wk->shared;
+  unsigned int local_counter = 0, open;
+  double bound;
+
+  while (current) {
+    if (search_stopped(sh)) {
+      destroy_tree(root);
+      break;
+    }
+
+    if (tick_due(wk)) {
+      bound = INFINITY;
+      open = open_subtree(root, current, &bound);
+      open += open_tasks(&wk->deque, &bound);
+      report_tick(wk, open, bound);
+    }
+
+    if (sh->n_workers > 1 && ++local_counter % DONATE_INTERVAL == 0 &&
+        atomic_load_explicit(&sh->idle, memory_order_relaxed) > 0 &&
+        task_deque_empty(&wk->deque)) {
+      donate_subtree(wk, root, current);
+    }
+
+    process_node(wk, current);
+    next_leaf(&current);
+  }
+  atomic_store_explicit(&wk->open_nodes, 0, memory_order_relaxed);
+}
+
+// ===========================================================================
+//                          COMPACT DEPTH-FIRST SEARCH
+// ===========================================================================
+
+// A lone depth-first worker needs no tree. The path from the root is a stack
+// of frames indexed by depth, two per depth for the include and exclude
+// children of the node above, and a single search state follows the path:
+// a frame's decision is applied on the way down and undone on the way back
+// from the few values it saved. Only the bound engine's duals are kept per
+// frame, as children are bounded against their parent's.
+
+typedef struct Frame {
+  Edge *edge;
+  Vertice *current_v;
+  Vertice *route_first;
+  uint64_t state_hash;
+  uint64_t head_hash;
+  bool include;
+  bool pending;
+  bool applied;
+  bool residual_known;
+  bool residual_ok;
+  int vehicle;
+  unsigned int edges_count;
+  unsigned int n_vertices_traversed;
+  unsigned int path_demand_so_far;
+  unsigned int largest_vehicle;
+  double cost_so_far;
+  double lower_bound;
+  double upper_bound;
+  // Undo log: the bound state of the edge's origin before the decision
+  double out_cost;
+  unsigned int min_cursor;
+  unsigned int max_cursor;
+} Frame;
+
+typedef struct CompactSearch {
+  Worker *wk;
+  Frame *frames;
+  unsigned int n_levels;
+  double *duals;
+  unsigned int *assign;
+  uint64_t *excluded;
+  uint64_t *included;
+  uint64_t *visited;
+  double *out_cost;
+  unsigned int *min_cursor;
+  unsigned int *max_cursor;
+  double *min_cost;
+  double *max_cost;
+  unsigned int *vehicles;
+  // Frames seen through the Tree routines and bound engines
+  Tree view;
+  Tree parent_view;
+} CompactSearch;
+
+static Frame *frame_at(CompactSearch *cs, unsigned int depth,
+                       unsigned int side) {
+  return &cs->frames[2*depth + side];
+}
+
+static Frame *applied_frame(CompactSearch *cs, unsigned int depth) {
+  Frame *f = frame_at(cs, depth, 0);
+  return f->applied ? f : f + 1;
+}
+
+// Makes room for frames down to n_levels - 1. Frames move, so pointers to
+// them do not survive this.
+static void reserve_frames(CompactSearch *cs, unsigned int n_levels) {
+  unsigned int n = cs->wk->shared->g->n;
+
+  if (n_levels <= cs->n_levels) return;
+  if (n_levels < 2*cs->n_levels) n_levels = 2*cs->n_levels;
+  cs->frames = realloc(cs->frames, 2*n_levels*sizeof(Frame));
+  // The greedy bound keeps no duals
+  if (cs->wk->shared->options->bound != &greedy_bound) {
+    cs->duals = realloc(cs->duals, (size_t)2*n_levels*2*n*sizeof(double));
+    cs->assign = realloc(cs->assign,
+                         (size_t)2*n_levels*n*sizeof(unsigned int));
+  }
+  cs->n_levels = n_levels;
+}
+
+static void init_tree_view(CompactSearch *cs, Tree *t) {
+  memset(t, 0, sizeof(Tree));
+  t->out_cost = cs->out_cost;
+  t->min_cursor = cs->min_cursor;
+  t->max_cursor = cs->max_cursor;
+  t->min_cost = cs->min_cost;
+  t->max_cost = cs->max_cost;
+  t->excluded = cs->excluded;
+  t->included = cs->included;
+  t->visited = cs->visited;
+  t->vehicles = cs->vehicles;
+}
+
+static void init_compact_search(CompactSearch *cs, Worker *wk) {
+  SearchShared *sh = wk->shared;
+  Graph *g = sh->g;
+
+  cs->wk = wk;
+  cs->frames = NULL;
+  cs->n_levels = 0;
+  cs->duals = NULL;
+  cs->assign = NULL;
+  reserve_frames(cs, 64);
+  cs->excluded = new_bitset(g->n*g->n);
+  cs->included = new_bitset(g->n*g->n);
+  cs->visited = new_bitset(g->n);
+  cs->out_cost = malloc(g->n*sizeof(double));
+  cs->min_cursor = malloc(g->n*sizeof(unsigned int));
+  cs->max_cursor = malloc(g->n*sizeof(unsigned int));
+  cs->min_cost = malloc(g->n*sizeof(double));
+  cs->max_cost = malloc(g->n*sizeof(double));
+  cs->vehicles = malloc(sh->fleet->n_classes*sizeof(unsigned int));
+  memcpy(cs->vehicles, sh->fleet->count,
+         sh->fleet->n_classes*sizeof(unsigned int));
+  init_tree_view(cs, &cs->view);
+  init_tree_view(cs, &cs->parent_view);
+  init_bound_state(&cs->view, g);
+}
+
+static void destroy_compact_search(CompactSearch *cs) {
+  free(cs->frames);
+  free(cs->duals);
+  free(cs->assign);
+  free(cs->excluded);
+  free(cs->included);
+  free(cs->visited);
+  free(cs->out_cost);
+  free(cs->min_cursor);
+  free(cs->max_cursor);
+  free(cs->min_cost);
+  free(cs->max_cost);
+  free(cs->vehicles);
+}
+
+// Points t at the node f stands for
+static Tree *view_frame(CompactSearch *cs, Frame *f, Tree *t) {
+  size_t slot = f - cs->frames, n = cs->wk->shared->g->n;
+
+  t->current_v = f->current_v;
+  t->route_first = f->route_first;
+  t->current_e = f->edge;
+  t->edge_value = f->include;
+  t->edges_count = f->edges_count;
+  t->n_vertices_traversed = f->n_vertices_traversed;
+  t->cost_so_far = f->cost_so_far;
+  t->path_demand_so_far = f->path_demand_so_far;
+  t->largest_vehicle = f->largest_vehicle;
+  t->lower_bound = f->lower_bound;
+  t->upper_bound = f->upper_bound;
+  t->residual_known = f->residual_known;
+  t->residual_ok = f->residual_ok;
+  t->duals = cs->duals ? cs->duals + slot*2*n : NULL;
+  t->assign = cs->assign ? cs->assign + slot*n : NULL;
+  return t;
+}
+
+// Applies the decision of f to the search state, as update_tree_sets and
+// update_bound_state do for a new Tree
+static void apply_frame(CompactSearch *cs, Frame *f) {
+  SearchShared *sh = cs->wk->shared;
+  Graph *g = sh->g;
+  Edge *e = f->edge;
+  unsigned int id = e->origin->id, degree = degree_out(g, id);
+  unsigned int *row = g->sorted + id*g->n;
+
+  f->out_cost = cs->out_cost[id];
+  f->min_cursor = cs->min_cursor[id];
+  f->max_cursor = cs->max_cursor[id];
+  f->applied = true;
+
+  bitset_set(f->include ? cs->included : cs->excluded, edge_id(g, e));
+  if (f->include && f->current_v != sh->origin) {
+    bitset_set(cs->visited, f->current_v->id);
+  }
+  if (f->include && (e->origin == sh->origin || !cs->out_cost[id])) {
+    cs->out_cost[id] += e->cost;
+  }
+  if (cs->min_cursor[id] < degree && row[cs->min_cursor[id]] == e->dest->id) {
+    do {
+      cs->min_cursor[id]++;
+    } while (cs->min_cursor[id] < degree &&
+             edge_ignored(&cs->view, id*g->n + row[cs->min_cursor[id]]));
+    cs->min_cost[id] = cursor_cost(g, id, cs->min_cursor[id]);
+  }
+  if (cs->max_cursor[id] > 0 && row[cs->max_cursor[id]-1] == e->dest->id) {
+    do {
+      cs->max_cursor[id]--;
+    } while (cs->max_cursor[id] > 0 &&
+             edge_ignored(&cs->view, id*g->n + row[cs->max_cursor[id]-1]));
+    cs->max_cost[id] = cs->max_cursor[id] > 0 ?
+                       cursor_cost(g, id, cs->max_cursor[id]-1) : 0;
+  }
+}
+
+static void undo_frame(CompactSearch *cs, Frame *f) {
+  SearchShared *sh = cs->wk->shared;
+  Graph *g = sh->g;
+  unsigned int id = f->edge->origin->id;
+
+  if (f->vehicle >= 0) {
+    cs->vehicles[f->vehicle]++;
+  }
+  bitset_clear(f->include ? cs->included : cs->excluded, edge_id(g, f->edge));
+  if (f->include && f->current_v != sh->origin) {
+    bitset_clear(cs->visited, f->current_v->id);
+  }
+  cs->out_cost[id] = f->out_cost;
+  if (cs->min_cursor[id] != f->min_cursor) {
+    cs->min_cursor[id] = f->min_cursor;
+    cs->min_cost[id] = cursor_cost(g, id, f->min_cursor);
+  }
+  if (cs->max_cursor[id] != f->max_cursor) {
+    cs->max_cursor[id] = f->max_cursor;
+    cs->max_cost[id] = f->max_cursor > 0 ?
+                       cursor_cost(g, id, f->max_cursor-1) : 0;
+  }
+  f->applied = false;
+}
+
+static void open_child(CompactSearch *cs, Frame *parent, Frame *child,
+                       Edge *e, bool include) {
+  Vertice *origin = cs->wk->shared->origin;
+  Vertice *v = include ? e->dest : e->origin;
+
+  child->edge = e;
+  child->current_v = v;
+  child->route_first = include && e->origin == origin ? v :
+                       parent->route_first;
+  child->state_hash = parent->state_hash;
+  child->head_hash = parent->head_hash;
+  if (cs->wk->shared->use_table) {
+    hash_child(cs->wk->shared, cs->excluded, e, include, &child->state_hash,
+               &child->head_hash);
+  }
+  child->include = include;
+  child->pending = child->applied = false;
+  child->vehicle = -1;
+  child->edges_count = parent->edges_count + include;
+  child->n_vertices_traversed = parent->n_vertices_traversed +
+                                (include*(v != origin));
+  child->cost_so_far = parent->cost_so_far + (include*(e->cost));
+  child->path_demand_so_far = parent->path_demand_so_far +
+                              (include*(v->demand));
+  child->largest_vehicle = parent->largest_vehicle;
+  child->residual_known = !include && e->origin != origin &&
+                          parent->residual_known;
+  child->residual_ok = parent->residual_ok;
+}
+
+// get_bounds over the search state. Summing only the row a decision changed
+// would round differently, and the greedy bounds of a complete path must
+// come out equal for it to survive the prune.
+static void greedy_bounds(CompactSearch *cs, Frame *f) {
+  get_bounds(&cs->view, cs->wk->shared->g, &f->lower_bound, &f->upper_bound);
+}
+
+// Bounds child as init_tree_from_parent and tighten_bound would, leaving the
+// search state as it was
+static double bound_child(CompactSearch *cs, Frame *parent, Frame *child,
+                          double upper_bound) {
+  apply_frame(cs, child);
+  greedy_bounds(cs, child);
+  evaluate_bound(cs->wk, view_frame(cs, child, &cs->view),
+                 view_frame(cs, parent, &cs->parent_view), upper_bound);
+  child->lower_bound = cs->view.lower_bound;
+  undo_frame(cs, child);
+  return child->lower_bound;
+}
+
+static bool residual_frame(CompactSearch *cs, Frame *f, Edge *e) {
+  SearchShared *sh = cs->wk->shared;
+  Tree *t = view_frame(cs, f, &cs->parent_view);
+  bool ret = residual_connected(sh->g, t, e, sh->origin, cs->wk->workspace);
+  f->residual_known = t->residual_known;
+  f->residual_ok = t->residual_ok;
+  return ret;
+}
+
+// The solution the path down to depth spells, edges listed from the last
+// one back as build_solution does
+static Solution *path_solution(CompactSearch *cs, unsigned int depth) {
+  Solution *s = malloc(sizeof(Solution));
+  unsigned int it_s = 0;
+  Frame *f;
+
+  init_solution(s, applied_frame(cs, depth)->edges_count);
+  for (; depth > 0; depth--) {
+    f = applied_frame(cs, depth);
+    if (f->include) {
+      s->cost += f->edge->cost;
+      s->edges[it_s++] = f->edge;
+    }
+  }
+  return s;
+}
+
+// process_node for the applied frame current, leaving its children pending
+// one level down
+static void process_frame(CompactSearch *cs, unsigned int depth,
+                          Frame *current) {
+  Worker *wk = cs->wk;
+  SearchShared *sh = wk->shared;
+  Graph *g = sh->g;
+  Vertice *origin = sh->origin, *vertice = current->current_v;
+  Frame *include = frame_at(cs, depth + 1, 0), *exclude = include + 1;
+  unsigned int degree, i;
+  int k;
+  Edge *edge, **out_edges;
+  double best_cost;
+
+  // Unopened frames may hold anything, applied_frame included
+  include->pending = exclude->pending = false;
+  include->applied = exclude->applied = false;
+  bump(&wk->nodes, 1);
+  note_depth(wk, depth);
+
+  if (vertice == origin) {
+    k = fleet_best_fit(sh->fleet, cs->vehicles, current->path_demand_so_far);
+    if (k < 0) {
+      bump(&wk->pruned_capacity, 1);
+      return;
+    }
+    cs->vehicles[k]--;
+    current->vehicle = k;
+    current->largest_vehicle = fleet_largest(sh->fleet, cs->vehicles);
+    current->path_demand_so_far = 0;
+    if (current->n_vertices_traversed == g->n) {
+      offer_solution(wk, path_solution(cs, depth));
+      return;
+    }
+  }
+
+  best_cost = atomic_load_explicit(&sh->incumbent->best_cost,
+                                   memory_order_relaxed);
+  if (current->lower_bound >= best_cost) {
+    bump(&wk->pruned_bound, 1);
+    return;
+  }
+  if (sh->use_table &&
+      dominated_state(wk, current->state_hash ^ current->head_hash, vertice,
+                      current->route_first, current->path_demand_so_far,
+                      cs->vehicles, current->cost_so_far, depth)) {
+    return;
+  }
+
+  out_edges = edges_out(g, vertice->id);
+  degree = degree_out(g, vertice->id);
+  for (i = 0; i < degree; i++) {
+    edge = out_edges[i];
+    if (edge_ignored(&cs->view, edge_id(g, edge))) continue;
+    if (bitset_test(cs->visited, edge->dest->id)) continue;
+
+    open_child(cs, current, include, edge, true);
+    if (symmetric_duplicate(sh, edge, current->route_first)) {
+      bump(&wk->pruned_symmetry, 1);
+    }
+    else if (current->cost_so_far + edge->cost >= best_cost) {
+      bump(&wk->pruned_bound, 1);
+    }
+    else if (include->path_demand_so_far > include->largest_vehicle) {
+      bump(&wk->pruned_capacity, 1);
+    }
+    else if (bound_child(cs, current, include, best_cost) > best_cost) {
+      bump(&wk->pruned_bound, 1);
+    }
+    else {
+      include->pending = true;
+      bump(&wk->created, 1);
+    }
+    bump(&wk->connectivity_checks, 1);
+    if (!residual_frame(cs, current, edge)) {
+      bump(&wk->pruned_connectivity, 1);
+    }
+    else {
+      open_child(cs, current, exclude, edge, false);
+      if (bound_child(cs, current, exclude, best_cost) >= best_cost) {
+        bump(&wk->pruned_bound, 1);
+      }
+      else {
+        exclude->pending = true;
+        bump(&wk->created, 1);
+      }
+    }
+
+    break;
+  }
+}
+
+// Sets up the root and its two children on the initial edge
+static void plant_compact_root(CompactSearch *cs, unsigned int initial) {
+  SearchShared *sh = cs->wk->shared;
+  Graph *g = sh->g;
+  Vertice *origin = sh->origin;
+  Frame *root = frame_at(cs, 0, 0), *child;
+  Edge *edge = edges_out(g, origin->id)[initial];
+
+  root->edge = NULL;
+  root->current_v = origin;
+  root->route_first = NULL;
+  root->state_hash = root->head_hash = 0;
+  root->include = root->pending = root->applied = false;
+  root->residual_known = root->residual_ok = false;
+  root->vehicle = -1;
+  root->edges_count = 0;
+  root->n_vertices_traversed = 1;
+  root->cost_so_far = 0;
+  root->path_demand_so_far = 0;
+  root->largest_vehicle = fleet_largest(sh->fleet, cs->vehicles);
+  greedy_bounds(cs, root);
+  if (sh->options->bound->init) {
+    sh->options->bound->init(view_frame(cs, root, &cs->view), g, origin,
+                             cs->wk->workspace);
+    root->lower_bound = cs->view.lower_bound;
+  }
+
+  child = frame_at(cs, 1, 0);
+  open_child(cs, root, child, edge, true);
+  bound_child(cs, root, child, INFINITY);
+  child->pending = true;
+
+  child = frame_at(cs, 1, 1);
+  open_child(cs, root, child, edge, false);
+  bound_child(cs, root, child, INFINITY);
+  child->pending = true;
+}
+
+// Counts the pending frames down to depth, lowering *bound to their least
+// lower bound
+static unsigned int open_frames(CompactSearch *cs, unsigned int depth,
+                                double *bound) {
+  unsigned int d, side, open = 0;
+  Frame *f;
+
+  for (d = 1; d <= depth; d++) {
+    for (side = 0; side < 2; side++) {
+      f = frame_at(cs, d, side);
+      if (!f->pending) continue;
+      open++;
+      if (f->lower_bound < *bound) *bound = f->lower_bound;
+    }
+  }
+  return open;
+}
+
+static void search_compact(CompactSearch *cs) {
+  SearchShared *sh = cs->wk->shared;
+  unsigned int depth = 1, open;
+  double bound;
+  Frame *f;
+
+  while (depth > 0) {
+    reserve_frames(cs, depth + 2);
+    f = frame_at(cs, depth, 0);
+    if (!f->pending) f++;
+    if (!f->pending) {
+      // Both children are done, and with them the node above
+      if (--depth > 0) {
+        undo_frame(cs, applied_frame(cs, depth));
+      }
+      continue;
+    }
+
+    if (search_stopped(sh)) return;
+
+    if (tick_due(cs->wk)) {
+      bound = INFINITY;
+      open = open_frames(cs, depth, &bound);
+      report_tick(cs->wk, open, bound);
+    }
+
+    f->pending = false;
+    apply_frame(cs, f);
+    process_frame(cs, depth, f);
+    if (frame_at(cs, depth + 1, 0)->pending ||
+        frame_at(cs, depth + 1, 1)->pending) {
+      depth++;
+    }
+    else {
+      undo_frame(cs, f);
+    }
+  }
+}
+
+// ===========================================================================
+//                              BEST-FIRST SEARCH
+// ===========================================================================
+
+// Ties go to the newest node, which keeps equal-bound searches diving
+static bool heap_before(HeapEntry *a, HeapEntry *b) {
+  return a->key < b->key || (a->key == b->key && a->seq > b->seq);
+}
+
+static void heap_push(NodeHeap *h, Tree *t) {
+  unsigned int i, parent;
+  HeapEntry entry;
+
+  if (h->size == h->capacity) {
+    h->capacity = h->capacity ? 2*h->capacity : 64;
+    h->entries = realloc(h->entries, h->capacity*sizeof(HeapEntry));
+  }
+  entry.key = t->lower_bound;
+  entry.seq = h->seq++;
+  entry.t = t;
+
+  for (i = h->size++; i > 0; i = parent) {
+    parent = (i - 1) / 2;
+    if (!heap_before(&entry, &h->entries[parent])) break;
+    h->entries[i] = h->entries[parent];
+  }
+  h->entries[i] = entry;
+}
+
+static Tree *heap_pop(NodeHeap *h) {
+  unsigned int i, child;
+  HeapEntry last;
+  Tree *t = h->entries[0].t;
+
+  last = h->entries[--h->size];
+  for (i = 0; (child = 2*i + 1) < h->size; i = child) {
+    if (child + 1 < h->size &&
+        heap_before(&h->entries[child + 1], &h->entries[child])) {
+      child++;
+    }
+    if (!heap_before(&h->entries[child], &last)) break;
+    h->entries[i] = h->entries[child];
+  }
+  h->entries[i] = last;
+  return t;
+}
+
+static void stack_push(NodeStack *st, Tree *t) {
+  if (st->size == st->capacity) {
+    st->capacity = st->capacity ? 2*st->capacity : 64;
+    st->nodes = realloc(st->nodes, st->capacity*sizeof(Tree *));
+  }
+  st->nodes[st->size++] = t;
+}
+
+// Queues the children of t: on the stack, right first so the left child is
+// processed next as in depth-first order, or on the heap by lower bound
+static void schedule_children(Tree *t, NodeHeap *h, NodeStack *st, bool dive) {
+  if (dive) {
+    if (t->right_child) stack_push(st, t->right_child);
+    if (t->left_child) stack_push(st, t->left_child);
+  }
+  else {
+    if (t->left_child) heap_push(h, t->left_child);
+    if (t->right_child) heap_push(h, t->right_child);
+  }
+}
+
+// The least lower bound among current and the queued nodes
+static double open_queued(NodeHeap *h, NodeStack *st, Tree *current) {
+  unsigned int i;
+  double bound = current->lower_bound;
+
+  if (h->size && h->entries[0].key < bound) bound = h->entries[0].key;
+  for (i = 0; i < st->size; i++) {
+    if (st->nodes[i]->lower_bound < bound) bound = st->nodes[i]->lower_bound;
+  }
+  return bound;
+}
+
+static void search_best_first(Worker *wk, Tree *root) {
+  SearchShared *sh = wk->shared;
+  TreePool *pool = wk->workspace->pool;
+  NodeHeap heap = {NULL, 0, 0, 0};
+  NodeStack stack = {NULL, 0, 0};
+  bool diving = sh->options->policy == POLICY_HYBRID, dive;
+  Tree *current;
+
+  schedule_children(root, &heap, &stack, diving);
+
+  while (true) {
+    // Hybrid search dives until there is an incumbent to bound against
+    if (diving && atomic_load(&sh->incumbent->best_cost) < INFINITY) {
+      diving = false;
+      while (stack.size) {
+        heap_push(&heap, stack.nodes[--stack.size]);
+      }
+    }
+
+    // Dives and the memory fallback drain the stack before the heap
+    if (stack.size) {
+      current = stack.nodes[--stack.size];
+    }
+    else if (heap.size) {
+      current = heap_pop(&heap);
+    }
+    else break;
+
+    if (search_stopped(sh)) {
+      destroy_tree(root);
+      break;
+    }
+
+    if (tick_due(wk)) {
+      report_tick(wk, heap.size + stack.size + 1,
+                  open_queued(&heap, &stack, current));
+    }
+
+    process_node(wk, current);
+    // Past the node cap, children are explored depth-first so the number of
+    // live nodes stops growing
+    dive = diving || pool->in_use >= sh->max_nodes;
+    schedule_children(current, &heap, &stack, dive);
+    release_leaf(current);
+  }
+
+  free(heap.entries);
+  free(stack.nodes);
+}
+
+static Tree *find_task(Worker *wk) {
+  SearchShared *sh = wk->shared;
+  unsigned int k, offset;
+  Tree *task = pop_task(&wk->deque);
+
+  if (task || sh->n_workers == 1) return task;
+  offset = rand_r(&wk->seed);
+  for (k = 0; k < sh->n_workers && !task; k++) {
+    if ((offset + k) % sh->n_workers == wk->id) continue;
+    task = steal_task(&sh->workers[(offset + k) % sh->n_workers].deque);
+  }
+  return task;
+}
+
+static void *worker_run(void *arg) {
+  Worker *wk = arg;
+  SearchShared *sh = wk->shared;
+  bool idle = false;
+  Tree *task;
+
+  if (wk->id == 0) {
+    if (sh->options->policy == POLICY_DFS) {
+      search_subtree(wk, sh->root, sh->root->left_child);
+    }
+    else {
+      search_best_first(wk, sh->root);
+    }
+    atomic_fetch_sub(&sh->pending, 1);
+  }
+
+  while (atomic_load(&sh->pending) > 0) {
+    task = find_task(wk);
+    if (!task) {
+      if (!idle) {
+        idle = true;
+        atomic_fetch_add(&sh->idle, 1);
+      }
+      sched_yield();
+      continue;
+    }
+    if (idle) {
+      idle = false;
+      atomic_fetch_sub(&sh->idle, 1);
+    }
+    if (atomic_load(&sh->stop)) {
+      destroy_tree(task);
+    }
+    else {
+      task = adopt_tree(wk->workspace->pool, task);
+      search_subtree(wk, task, task);
+    }
+    atomic_fetch_sub(&sh->pending, 1);
+  }
+
+  return NULL;
+}
+
+// Sets up sh->root and its two children on the initial edge
+static void plant_root(SearchShared *sh, unsigned int initial) {
+  Graph *g = sh->g;
+  Vertice *origin = sh->origin;
+  Workspace *w = sh->workers[0].workspace;
+  const BoundEngine *bound = sh->options->bound;
+  Tree *root, *nnode;
+  Edge *edge = edges_out(g, origin->id)[initial];
+
+  root = pool_get_tree(w->pool);
+  init_tree(root, origin, NULL, false, NULL, sh->fleet, origin, g);
+  if (bound->init) bound->init(root, g, origin, w);
+
+  nnode = pool_get_tree(w->pool);
+  init_tree_from_parent(nnode, root, edge->dest, edge, true, origin, g);
+  hash_tree(sh, root, nnode);
+  if (bound->update) bound->update(nnode, root, g, origin, w, INFINITY);
+  add_child_to_parent(root, nnode);
+
+  nnode = pool_get_tree(w->pool);
+  init_tree_from_parent(nnode, root, edge->origin, edge, false, origin, g);
+  hash_tree(sh, root, nnode);
+  if (bound->update) bound->update(nnode, root, g, origin, w, INFINITY);
+  add_child_to_parent(root, nnode);
+
+  sh->root = root;
+}
+
+// Runs one search rooted at the initial-th out edge of the depot, reporting
+// solutions to inc, which may be shared with other searches
+static void run_search(Graph *g, Fleet *c, Vertice *origin,
+                       int n_iter, unsigned int initial, SearchOptions *o,
+                       Incumbent *inc) {
+  unsigned int i, n_threads = o->n_threads, reserve = 2*g->n*g->n + 1;
+  bool compact;
+  Worker *workers;
+  SearchShared *sh;
+  CompactSearch cs;
+  SearchStats stats;
+
+  log_message(LOG_INFO, "Begin branch and bound!\n\n");
+
+  // Only depth-first search is split across workers
+  if (n_threads < 1 || o->policy != POLICY_DFS) n_threads = 1;
+  // A lone depth-first worker walks a stack of frames instead of a tree
+  compact = n_threads == 1 && o->policy == POLICY_DFS;
+  sh = malloc(sizeof(SearchShared));
+  workers = calloc(n_threads, sizeof(Worker));
+  sh->g = g;
+  sh->fleet = c;
+  sh->origin = origin;
+  sh->n_iter = n_iter;
+  sh->options = o;
+  sh->records = NULL;
+  sh->n_records = 0;
+  clock_gettime(CLOCK_MONOTONIC, &sh->start);
+  sh->n_workers = n_threads;
+  sh->workers = workers;
+  sh->incumbent = inc;
+  sh->root = NULL;
+  sh->initial = initial;
+  sh->orient_routes = o->break_symmetry && g->symmetric;
+  sh->use_table = o->table_bytes > 0;
+  if (sh->use_table) init_state_keys(&sh->keys, g->n, 0x5eed);
+  // A trace is sampled even without progress lines
+  sh->tick_interval = o->progress_interval;
+  if (sh->tick_interval <= 0 && o->trace) sh->tick_interval = TRACE_INTERVAL;
+  atomic_init(&sh->next_progress, o->progress_interval);
+  atomic_init(&sh->found, false);
+  atomic_init(&sh->iterations, 0);
+  atomic_init(&sh->pending, 1);
+  atomic_init(&sh->idle, 0);
+  atomic_init(&sh->stop, false);
+
+  for (i = 0; i < n_threads; i++) {
+    workers[i].id = i;
+    workers[i].seed = i + 1;
+    workers[i].shared = sh;
+    if (i == 0 && o->workspace) {
+      workers[i].workspace = o->workspace;
+      fit_workspace(workers[i].workspace, g, c);
+    }
+    else {
+      workers[i].workspace = malloc(sizeof(Workspace));
+      init_workspace(workers[i].workspace, g, c);
+    }
+    init_task_deque(&workers[i].deque);
+    if (sh->use_table) {
+      init_transposition_table(&workers[i].table, o->table_bytes);
+    }
+    atomic_init(&workers[i].nodes, 0);
+    atomic_init(&workers[i].open_bound, INFINITY);
+  }
+
+  // Keep room for a depth-first dive on top of the open-node cap
+  sh->max_nodes = o->max_nodes;
+  if (!sh->max_nodes) {
+    sh->max_nodes = BEST_FIRST_MEMORY / workers[0].workspace->pool->stride;
+  }
+  if (o->policy != POLICY_DFS) {
+    workers[0].workspace->pool->capacity = sh->max_nodes + reserve;
+  }
+
+  if (compact) {
+    init_compact_search(&cs, &workers[0]);
+    plant_compact_root(&cs, initial);
+  }
+  else {
+    plant_root(sh, initial);
+  }
+
+  if (compact) {
+    search_compact(&cs);
+    destroy_compact_search(&cs);
+  }
+  else if (n_threads == 1) {
+    worker_run(&workers[0]);
+  }
+  else {
+    for (i = 0; i < n_threads; i++) {
+      pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+    }
+    for (i = 0; i < n_threads; i++) {
+      pthread_join(workers[i].thread, NULL);
+    }
+  }
+
+  collect_search_stats(sh, &stats);
+  print_search_stats(sh, &stats);
+  trace_search(sh, &stats);
+  if (o->stats) {
+    pthread_mutex_lock(&inc->lock);
+    accumulate_search_stats(o->stats, &stats);
+    pthread_mutex_unlock(&inc->lock);
+  }
+
+  for (i = 0; i < n_threads; i++) {
+    destroy_task_deque(&workers[i].deque);
+    if (sh->use_table) destroy_transposition_table(&workers[i].table);
+    if (workers[i].workspace != o->workspace) {
+      destroy_workspace(workers[i].workspace);
+    }
+  }
+  if (sh->use_table) destroy_state_keys(&sh->keys);
+  free(sh->records);
+  free(workers);
+  free(sh);
+}
+
+static void *restart_run(void *arg) {
+  RestartPool *rp = arg;
+  unsigned int i;
+
+  while ((i = atomic_fetch_add(&rp->next, 1)) < rp->n_restarts) {
+    run_search(rp->g, rp->c, rp->origin, rp->n_iter, i, rp->options,
+               rp->incumbent);
+  }
+
+  return NULL;
+}
+
+// ===========================================================================
+//                                   SOLVERS
+// ===========================================================================
+
+void init_search_options(SearchOptions *o) {
+  o->n_threads = 1;
+  o->policy = POLICY_DFS;
+  o->max_nodes = 0;
+  o->bound = &greedy_bound;
+  o->break_symmetry = false;
+  o->table_bytes = TABLE_BYTES;
+  o->warm_start = NULL;
+  o->stats = NULL;
+  o->on_incumbent = NULL;
+  o->incumbent_context = NULL;
+  o->progress_interval = 0;
+  o->trace = NULL;
+  o->workspace = NULL;
+}
+
+static void trace_instant(FILE *trace, const char *name) {
+  struct timespec stamp;
+  clock_gettime(CLOCK_MONOTONIC, &stamp);
+  fprintf(trace, "{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"g\", "
+          "\"ts\": %.0f, \"pid\": 0, \"tid\": 0}", name,
+          microseconds(&stamp));
+}
+
+// A trace is a JSON array of events in the Trace Event Format, which
+// chrome://tracing and Perfetto load: a counter sample per worker tick and a
+// span per search, between an instant at each end
+void begin_search_trace(FILE *trace) {
+  fprintf(trace, "[\n");
+  trace_instant(trace, "begin");
+}
+
+void end_search_trace(FILE *trace) {
+  fprintf(trace, ",\n");
+  trace_instant(trace, "end");
+  fprintf(trace, "\n]\n");
+}
+
+bool parse_node_policy(const char *name, NodePolicy *policy) {
+  if (!strcmp(name, "dfs")) {
+    *policy = POLICY_DFS;
+  }
+  else if (!strcmp(name, "best")) {
+    *policy = POLICY_BEST_FIRST;
+  }
+  else if (!strcmp(name, "hybrid")) {
+    *policy = POLICY_HYBRID;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+Solution *branch_bound_vrp_solve_with(Graph *g, Fleet *c,
+                                      Vertice *origin, int n_iter,
+                                      unsigned int initial,
+                                      SearchOptions *o) {
+  Solution *best_solution;
+  Incumbent inc;
+
+  init_incumbent(&inc);
+  seed_incumbent(&inc, o->warm_start);
+  run_search(g, c, origin, n_iter, initial, o, &inc);
+  best_solution = inc.best_solution;
+  destroy_incumbent(&inc);
+
+  return best_solution;
+}
+
+Solution *branch_bound_vrp_solve(Graph *g, Fleet *c, Vertice *origin,
+                                 int n_iter, unsigned int initial) {
+  SearchOptions o;
+  init_search_options(&o);
+  return branch_bound_vrp_solve_with(g, c, origin, n_iter, initial, &o);
+}
+
+Solution *restart_branch_bound_vrp_solve(Graph *g, Fleet *c,
+                                         Vertice *origin, int n_iter,
+                                         unsigned int n_restarts,
+                                         SearchOptions *o) {
+  unsigned int i, n_threads = o->n_threads;
+  pthread_t *threads;
+  Solution *best_solution;
+  SearchOptions restart_options;
+  Incumbent inc;
+  RestartPool rp;
+
+  if (n_restarts > degree_out(g, origin->id)) {
+    n_restarts = degree_out(g, origin->id);
+  }
+  if (n_threads > n_restarts) n_threads = n_restarts;
+  if (n_threads < 1) n_threads = 1;
+
+  // Threads go to running restarts side by side, one worker each, and
+  // restarts on a single thread share a workspace
+  restart_options = *o;
+  restart_options.n_threads = 1;
+  if (n_threads > 1) {
+    restart_options.workspace = NULL;
+  }
+  else if (!o->workspace) {
+    restart_options.workspace = malloc(sizeof(Workspace));
+    init_workspace(restart_options.workspace, g, c);
+  }
+
+  // Each restart is an independent search, but they all prune against the
+  // best solution any of them has found so far
+  init_incumbent(&inc);
+  seed_incumbent(&inc, o->warm_start);
+  rp.g = g;
+  rp.c = c;
+  rp.origin = origin;
+  rp.n_iter = n_iter;
+  rp.options = &restart_options;
+  rp.n_restarts = n_restarts;
+  rp.incumbent = &inc;
+  atomic_init(&rp.next, 0);
+
+  if (n_threads == 1) {
+    restart_run(&rp);
+  }
+  else {
+    threads = calloc(n_threads, sizeof(pthread_t));
+    for (i = 0; i < n_threads; i++) {
+      pthread_create(&threads[i], NULL, restart_run, &rp);
+    }
+    for (i = 0; i < n_threads; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    free(threads);
+  }
+  if (restart_options.workspace != o->workspace) {
+    destroy_workspace(restart_options.workspace);
+  }
+
+  best_solution = inc.best_solution;
+  destroy_incumbent(&inc);
+
+  return best_solution;
+}
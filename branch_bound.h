@@ -0,0 +1,82 @@
+#ifndef BRANCH_BOUND_H
+#define BRANCH_BOUND_H
+
+#include <stdio.h>
+
+#include "bounds.h"
+#include "data_structures.h"
+
+typedef enum NodePolicy {
+  POLICY_DFS,
+  POLICY_BEST_FIRST,
+  POLICY_HYBRID
+} NodePolicy;
+
+// Nodes explored and children cut off, by the reason they were, and where
+// the search spent its effort
+typedef struct SearchStats {
+  unsigned long nodes;
+  unsigned long created;
+  unsigned long pruned_bound;
+  unsigned long pruned_capacity;
+  unsigned long pruned_connectivity;
+  unsigned long pruned_symmetry;
+  unsigned long pruned_dominance;
+  unsigned long table_probes;
+  unsigned long table_hits;
+  unsigned long connectivity_checks;
+  unsigned long bound_evaluations;
+  double bound_seconds;
+  unsigned int max_depth;
+} SearchStats;
+
+// Told of each new incumbent and the seconds into its search it was found.
+// Calls come under the incumbent lock, so they never overlap, and the
+// solution is only borrowed.
+typedef void (*IncumbentCallback)(Solution *s, double seconds,
+                                  void *context);
+
+typedef struct SearchOptions {
+  unsigned int n_threads;
+  NodePolicy policy;
+  unsigned int max_nodes;
+  const BoundEngine *bound;
+  // Searches each route in one direction only when costs are symmetric.
+  // Off by default.
+  bool break_symmetry;
+  // Bytes of each worker's transposition table, or 0 for none
+  size_t table_bytes;
+  // A known solution the search starts from as its incumbent, or NULL
+  Solution *warm_start;
+  // Accumulates the counts of every search run with these options, or NULL
+  SearchStats *stats;
+  // Reports incumbents with incumbent_context, or NULL to keep quiet
+  IncumbentCallback on_incumbent;
+  void *incumbent_context;
+  // Seconds between progress lines on stderr, or 0 for none
+  double progress_interval;
+  // Trace Event Format file the workers sample their counters to, or NULL
+  FILE *trace;
+  // A workspace the first worker fits and reuses instead of allocating its
+  // own, so that searches run one after another on a thread share it, or
+  // NULL
+  Workspace *workspace;
+} SearchOptions;
+
+void init_search_options(SearchOptions *o);
+void begin_search_trace(FILE *trace);
+void end_search_trace(FILE *trace);
+bool parse_node_policy(const char *name, NodePolicy *policy);
+
+Solution *branch_bound_vrp_solve(Graph *g, Fleet *c, Vertice *origin,
+                                 int n_iter, unsigned int initial);
+Solution *branch_bound_vrp_solve_with(Graph *g, Fleet *c,
+                                      Vertice *origin, int n_iter,
+                                      unsigned int initial,
+                                      SearchOptions *o);
+Solution *restart_branch_bound_vrp_solve(Graph *g, Fleet *c,
+                                         Vertice *origin, int n_iter,
+                                         unsigned int n_restarts,
+                                         SearchOptions *o);
+
+#endif
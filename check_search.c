@@ -0,0 +1,334 @@
+// Regression check for the exact search: solves random instances small
+// enough to enumerate, serially, on threads, under every node selection
+// policy and with the orientation rule, and compares every result with the
+// optimum over all partitions of the customers into routes. It also checks
+// that the exclude branch keeps a state only the end of the route being
+// built can still complete.
+//
+// Build: make check_search
+// Usage: ./check_search [instances] [n]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bounds.h"
+#include "branch_bound.h"
+#include "data_structures.h"
+#include "report.h"
+
+// Runs of each threaded mode, as their result may depend on timing
+#define THREAD_RUNS 3
+// The solver's default transposition table, 16 MB per worker
+#define TABLE ((size_t)16 << 20)
+
+typedef struct CheckMode {
+  const char *name;
+  unsigned int n_threads;
+  NodePolicy policy;
+  unsigned int max_nodes;
+  bool symmetry;
+  size_t table_bytes;
+  const char *bound;
+} CheckMode;
+
+static const CheckMode modes[] = {
+  {"serial", 1, POLICY_DFS, 0, false, TABLE, "greedy"},
+  {"threads 2", 2, POLICY_DFS, 0, false, TABLE, "greedy"},
+  {"threads 4", 4, POLICY_DFS, 0, false, TABLE, "greedy"},
+  {"threads 8", 8, POLICY_DFS, 0, false, TABLE, "greedy"},
+  {"best-first", 1, POLICY_BEST_FIRST, 0, false, TABLE, "greedy"},
+  {"hybrid", 1, POLICY_HYBRID, 0, false, TABLE, "greedy"},
+  // Few enough live nodes that the search falls back to diving
+  {"best-first 64", 1, POLICY_BEST_FIRST, 64, false, TABLE, "greedy"},
+  {"symmetry", 1, POLICY_DFS, 0, true, TABLE, "greedy"},
+  {"symmetry threads", 4, POLICY_DFS, 0, true, TABLE, "greedy"},
+  {"no table", 1, POLICY_DFS, 0, false, 0, "greedy"},
+  // 32 buckets, which fill early on, so new states replace old ones
+  {"table 4 KB", 1, POLICY_DFS, 0, false, 4096, "greedy"},
+  {"assignment", 1, POLICY_DFS, 0, false, TABLE, "assignment"},
+  {"ktree", 1, POLICY_DFS, 0, false, TABLE, "ktree"},
+};
+#define N_MODES (sizeof(modes)/sizeof(modes[0]))
+
+typedef struct CheckInstance {
+  unsigned int n;
+  unsigned int *demand;
+  unsigned int *capacity;
+} CheckInstance;
+
+// ===========================================================================
+//                                 INSTANCES
+// ===========================================================================
+
+// Random points in a square, demands of 1 to 15 and a vehicle per vertex.
+// Odd seeds stretch each cost by up to half, every fourth one mixes vehicle
+// capacities.
+static bool write_instance(const char *path, unsigned int seed,
+                           CheckInstance *ci) {
+  unsigned int i, j, n = ci->n, x[16], y[16];
+  bool asymmetric = seed % 2, mixed = seed % 4 == 3;
+  FILE *f = fopen(path, "w");
+  double d;
+
+  if (!f) return false;
+  srand(seed);
+  fprintf(f, "%u\n", n);
+  for (i = 0; i < n; i++) {
+    x[i] = rand() % 101;
+    y[i] = rand() % 101;
+    ci->demand[i] = i ? 1 + rand() % 15 : 0;
+    fprintf(f, "%u\n", ci->demand[i]);
+  }
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < n; j++) {
+      if (i == j) continue;
+      d = hypot((double)x[i] - x[j], (double)y[i] - y[j]);
+      if (asymmetric) d *= 1 + 0.5*rand()/RAND_MAX;
+      fprintf(f, "%.17g\n", d);
+    }
+  }
+  for (i = 0; i < n; i++) {
+    ci->capacity[i] = mixed ? 30 + 10*(rand() % 3) : 40;
+    fprintf(f, "%u\n", ci->capacity[i]);
+  }
+  return fclose(f) == 0;
+}
+
+// ===========================================================================
+//                                  OPTIMUM
+// ===========================================================================
+
+// The cheapest route through every set of customers, customer k being
+// vertex k + 1, by dynamic programming over paths leaving the depot
+static double *route_costs(Graph *g, unsigned int m) {
+  unsigned int mask, j, k, n_masks = 1u << m;
+  double *path = malloc((size_t)n_masks*m*sizeof(double));
+  double *route = malloc(n_masks*sizeof(double)), d;
+
+  for (mask = 0; mask < n_masks; mask++) {
+    route[mask] = INFINITY;
+    for (j = 0; j < m; j++) {
+      path[mask*m + j] = mask == 1u << j ? graph_cost(g, 0, j + 1) : INFINITY;
+    }
+  }
+  for (mask = 1; mask < n_masks; mask++) {
+    for (j = 0; j < m; j++) {
+      d = path[mask*m + j];
+      if (isinf(d)) continue;
+      if (d + graph_cost(g, j + 1, 0) < route[mask]) {
+        route[mask] = d + graph_cost(g, j + 1, 0);
+      }
+      for (k = 0; k < m; k++) {
+        if (mask >> k & 1) continue;
+        if (d + graph_cost(g, j + 1, k + 1) < path[(mask | 1u << k)*m + k]) {
+          path[(mask | 1u << k)*m + k] = d + graph_cost(g, j + 1, k + 1);
+        }
+      }
+    }
+  }
+  free(path);
+  return route;
+}
+
+static int by_decreasing(const void *a, const void *b) {
+  unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+  return (x < y) - (x > y);
+}
+
+// Whether the routes' loads fit distinct vehicles, pairing them largest
+// first
+static bool fleet_fits(CheckInstance *ci, unsigned int *loads,
+                       unsigned int n_routes) {
+  unsigned int i, sorted[16];
+  memcpy(sorted, loads, n_routes*sizeof(unsigned int));
+  qsort(sorted, n_routes, sizeof(unsigned int), by_decreasing);
+  for (i = 0; i < n_routes; i++) {
+    if (sorted[i] > ci->capacity[i]) return false;
+  }
+  return true;
+}
+
+// Puts customer k in each route so far and in a route of its own
+static void enumerate_routes(CheckInstance *ci, double *route,
+                             unsigned int k, unsigned int m,
+                             unsigned int *masks, unsigned int *loads,
+                             unsigned int n_routes, double *best) {
+  unsigned int r;
+  double cost = 0;
+
+  if (k == m) {
+    if (!fleet_fits(ci, loads, n_routes)) return;
+    for (r = 0; r < n_routes; r++) {
+      cost += route[masks[r]];
+    }
+    if (cost < *best) *best = cost;
+    return;
+  }
+  for (r = 0; r <= n_routes; r++) {
+    if (r == n_routes) {
+      masks[r] = loads[r] = 0;
+    }
+    masks[r] |= 1u << k;
+    loads[r] += ci->demand[k + 1];
+    enumerate_routes(ci, route, k + 1, m, masks, loads,
+                     n_routes + (r == n_routes), best);
+    masks[r] &= ~(1u << k);
+    loads[r] -= ci->demand[k + 1];
+  }
+}
+
+static double optimum(Graph *g, CheckInstance *ci) {
+  unsigned int m = ci->n - 1, masks[16], loads[16];
+  double *route = route_costs(g, m), best = INFINITY;
+
+  qsort(ci->capacity, ci->n, sizeof(unsigned int), by_decreasing);
+  enumerate_routes(ci, route, 0, m, masks, loads, 0, &best);
+  free(route);
+  return best;
+}
+
+// ===========================================================================
+//                                   CHECKS
+// ===========================================================================
+
+static bool same_cost(double a, double b) {
+  if (isinf(a) || isinf(b)) return a == b;
+  return fabs(a - b) <= 1e-9*fmax(1, fabs(b));
+}
+
+static double solve(Instance *inst, const CheckMode *mode) {
+  SearchOptions o;
+  Solution *s;
+  double cost;
+
+  init_search_options(&o);
+  o.n_threads = mode->n_threads;
+  o.policy = mode->policy;
+  o.max_nodes = mode->max_nodes;
+  o.break_symmetry = mode->symmetry;
+  o.table_bytes = mode->table_bytes;
+  o.bound = find_bound_engine(mode->bound);
+  s = branch_bound_vrp_solve_with(inst->g, inst->vehicles, inst->vertices[0],
+                                  0, 0, &o);
+  cost = s ? s->cost : INFINITY;
+  destroy_solution(s);
+  return cost;
+}
+
+// Writes the seed-th instance and reads it back, or returns NULL
+static Instance *load_instance(unsigned int seed, CheckInstance *ci) {
+  char path[] = "/tmp/check_search_XXXXXX";
+  Instance *inst = malloc(sizeof(Instance));
+  int fd = mkstemp(path);
+
+  if (fd < 0 || close(fd) || !write_instance(path, seed, ci) ||
+      !read_instance(inst, path)) {
+    printf("seed %u: could not write instance\n", seed);
+    unlink(path);
+    free(inst);
+    return NULL;
+  }
+  unlink(path);
+  return inst;
+}
+
+// Returns the number of modes that missed the optimum of the seed-th
+// instance
+static unsigned int check_instance(unsigned int seed, unsigned int n,
+                                   unsigned int *failures) {
+  unsigned int k, run, runs, wrong = 0, demand[16], capacity[16];
+  CheckInstance ci = {n, demand, capacity};
+  Instance *inst = load_instance(seed, &ci);
+  double best, cost;
+
+  if (!inst) return 1;
+  best = optimum(inst->g, &ci);
+
+  for (k = 0; k < N_MODES; k++) {
+    runs = modes[k].n_threads > 1 ? THREAD_RUNS : 1;
+    for (run = 0; run < runs; run++) {
+      cost = solve(inst, &modes[k]);
+      if (same_cost(cost, best)) continue;
+      printf("seed %u, %s: %.6f, optimum %.6f\n", seed, modes[k].name, cost,
+             best);
+      failures[k]++;
+      wrong++;
+      break;
+    }
+  }
+  destroy_instance(inst);
+  return wrong;
+}
+
+// The exclude branch must keep a state whose customers left only the end of
+// the route being built still reaches. With the depot's edge to customer 2
+// excluded and the route at customer 1, excluding 1's way back leaves the
+// route 0 1 2 0; excluding 1's edge to 2 as well leaves none. Returns the
+// number of the two cases residual_connected gets wrong.
+static unsigned int check_route_end(void) {
+  unsigned int demand[3], capacity[3], wrong = 0;
+  CheckInstance ci = {3, demand, capacity};
+  Instance *inst = load_instance(1, &ci);
+  Graph *g;
+  Vertice *origin;
+  Workspace *w;
+  TreePool *pool;
+  Tree *root, *banned, *route, *stuck;
+
+  if (!inst) return 2;
+  g = inst->g;
+  origin = inst->vertices[0];
+  w = malloc(sizeof(Workspace));
+  init_workspace(w, g, inst->vehicles);
+  pool = malloc(sizeof(TreePool));
+  init_tree_pool(pool, g, inst->vehicles, 4);
+
+  root = pool_get_tree(pool);
+  init_tree(root, origin, NULL, false, NULL, inst->vehicles, origin, g);
+  banned = pool_get_tree(pool);
+  init_tree_from_parent(banned, root, origin, graph_edge(g, 0, 2), false,
+                        origin, g);
+  route = pool_get_tree(pool);
+  init_tree_from_parent(route, banned, g->v[1], graph_edge(g, 0, 1), true,
+                        origin, g);
+  if (!residual_connected(g, route, graph_edge(g, 1, 0), origin, w)) wrong++;
+
+  stuck = pool_get_tree(pool);
+  init_tree_from_parent(stuck, route, g->v[1], graph_edge(g, 1, 2), false,
+                        origin, g);
+  if (residual_connected(g, stuck, graph_edge(g, 1, 0), origin, w)) wrong++;
+
+  destroy_tree_pool(pool);
+  destroy_workspace(w);
+  destroy_instance(inst);
+  return wrong;
+}
+
+int main(int argc, char const *argv[]) {
+  unsigned int seed, k, n_instances = 40, n = 9, failures[N_MODES] = {0};
+  unsigned int wrong = 0;
+
+  if (argc > 1) n_instances = atoi(argv[1]);
+  if (argc > 2) n = atoi(argv[2]);
+  if (n < 2 || n > 12) {
+    printf("ERROR: Please specify between 2 and 12 vertices.\n");
+    return 1;
+  }
+
+  set_log_level(LOG_NONE);
+  for (seed = 1; seed <= n_instances; seed++) {
+    wrong += check_instance(seed, n, failures);
+  }
+  for (k = 0; k < N_MODES; k++) {
+    printf("%-16s %u/%u wrong\n", modes[k].name, failures[k], n_instances);
+  }
+  k = check_route_end();
+  printf("%-16s %u/2 wrong\n", "route end", k);
+  wrong += k;
+  return wrong > 0;
+}
@@ -0,0 +1,285 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "construction.h"
+
+// Most starting angles the sweep tries
+#define SWEEP_STARTS 64
+
+typedef struct Saving {
+  double value;
+  unsigned int from, to;
+} Saving;
+
+typedef struct RouteKey {
+  double key;
+  unsigned int id;
+} RouteKey;
+
+static int compare_route_keys(const void *a, const void *b) {
+  const RouteKey *ra = a, *rb = b;
+  if (ra->key != rb->key) return ra->key < rb->key ? -1 : 1;
+  return ra->id < rb->id ? -1 : ra->id > rb->id;
+}
+
+// Builds the Solution a sequence of sequence_length vertices walks, or NULL
+// when the fleet cannot cover its routes
+static Solution *solution_from_sequence(Graph *g, Fleet *c, Vertice *origin,
+                                        Vertice **sequence,
+                                        unsigned int sequence_length) {
+  Solution *s = malloc(sizeof(Solution));
+  init_solution(s, sequence_length - 1);
+  if (!build_solution_from_sequence(s, sequence, g, c, origin)) {
+    destroy_solution(s);
+    return NULL;
+  }
+  return s;
+}
+
+// ===========================================================================
+//                                   SAVINGS
+// ===========================================================================
+
+static void sift_down(Saving *heap, unsigned int size, unsigned int i) {
+  unsigned int child;
+  Saving last = heap[i];
+
+  for (; (child = 2*i + 1) < size; i = child) {
+    if (child + 1 < size && heap[child + 1].value > heap[child].value) {
+      child++;
+    }
+    if (heap[child].value <= last.value) break;
+    heap[i] = heap[child];
+  }
+  heap[i] = last;
+}
+
+static void push_saving(Graph *g, Vertice *origin, Saving *heap,
+                        unsigned int *size, unsigned int from,
+                        unsigned int to) {
+  double value = graph_cost(g, from, origin->id) +
+                 graph_cost(g, origin->id, to) - graph_cost(g, from, to);
+  if (value <= 0) return;
+  heap[*size].value = value;
+  heap[*size].from = from;
+  heap[*size].to = to;
+  (*size)++;
+}
+
+// Parallel Clarke-Wright: every customer starts on a route of its own, and
+// routes are joined end to start in order of decreasing saving as long as
+// the load fits the largest vehicle. Candidate joins come from the
+// neighbour lists, kept in a heap.
+Solution *savings_solution(Graph *g, Fleet *c, Vertice *origin) {
+  unsigned int i, j, v, u, r, a, b, size = 0, n_routes = 0, length = 0;
+  unsigned int k = g->n_neighbours, capacity = fleet_largest(c, c->count);
+  unsigned int *route, *next, *first, *last, *load, *members;
+  RouteKey *order;
+  Saving *heap, best;
+  Vertice **sequence;
+  Solution *s;
+
+  heap = malloc((size_t)2*g->n*(k ? k : 1)*sizeof(Saving));
+  for (v = 0; v < g->n; v++) {
+    if (v == origin->id) continue;
+    for (i = 0; i < k; i++) {
+      u = g->neighbours[(size_t)v*k + i];
+      if (u == origin->id || u == v) continue;
+      push_saving(g, origin, heap, &size, v, u);
+      push_saving(g, origin, heap, &size, u, v);
+    }
+  }
+  for (i = size/2; i > 0; i--) {
+    sift_down(heap, size, i - 1);
+  }
+
+  // Routes are named after a member; next chains each route front to back
+  route = malloc(g->n*sizeof(unsigned int));
+  next = malloc(g->n*sizeof(unsigned int));
+  first = malloc(g->n*sizeof(unsigned int));
+  last = malloc(g->n*sizeof(unsigned int));
+  load = malloc(g->n*sizeof(unsigned int));
+  members = malloc(g->n*sizeof(unsigned int));
+  for (v = 0; v < g->n; v++) {
+    route[v] = first[v] = last[v] = v;
+    next[v] = g->n;
+    load[v] = g->v[v]->demand;
+    members[v] = 1;
+  }
+
+  while (size) {
+    best = heap[0];
+    heap[0] = heap[--size];
+    sift_down(heap, size, 0);
+
+    a = route[best.from];
+    b = route[best.to];
+    if (a == b || last[a] != best.from || first[b] != best.to) continue;
+    if (load[a] + load[b] > capacity) continue;
+
+    // Relabel the shorter route into the longer one
+    r = members[a] >= members[b] ? a : b;
+    for (v = first[r == a ? b : a]; v < g->n; v = next[v]) {
+      route[v] = r;
+    }
+    next[best.from] = best.to;
+    first[r] = first[a];
+    last[r] = last[b];
+    load[r] = load[a] + load[b];
+    members[r] = members[a] + members[b];
+  }
+  free(heap);
+
+  // Heaviest routes first, so best-fit hands out the large vehicles to them
+  order = malloc(g->n*sizeof(RouteKey));
+  for (v = 0; v < g->n; v++) {
+    if (v == origin->id || route[v] != v) continue;
+    order[n_routes].key = -(double)load[v];
+    order[n_routes].id = v;
+    n_routes++;
+  }
+  qsort(order, n_routes, sizeof(RouteKey), compare_route_keys);
+
+  sequence = malloc((2*g->n + 1)*sizeof(Vertice *));
+  sequence[length++] = origin;
+  for (j = 0; j < n_routes; j++) {
+    for (v = first[order[j].id]; v < g->n; v = next[v]) {
+      sequence[length++] = g->v[v];
+    }
+    sequence[length++] = origin;
+  }
+  s = solution_from_sequence(g, c, origin, sequence, length);
+
+  free(sequence);
+  free(order);
+  free(route);
+  free(next);
+  free(first);
+  free(last);
+  free(load);
+  free(members);
+
+  return s;
+}
+
+// ===========================================================================
+//                                    SWEEP
+// ===========================================================================
+
+// Cuts the customers, in angular order from start, into routes that fill
+// the largest vehicle left. Returns the sequence length, or 0 when the
+// fleet runs out.
+static unsigned int sweep_routes(Graph *g, Fleet *c, Vertice *origin,
+                                 RouteKey *angles, unsigned int n_customers,
+                                 unsigned int start, unsigned int *counts,
+                                 Vertice **sequence) {
+  unsigned int i, load = 0, capacity, length = 0;
+  int k;
+  Vertice *v;
+
+  memcpy(counts, c->count, c->n_classes*sizeof(unsigned int));
+  capacity = fleet_largest(c, counts);
+  sequence[length++] = origin;
+  for (i = 0; i <= n_customers; i++) {
+    v = i < n_customers ? g->v[angles[(start + i) % n_customers].id] : NULL;
+    if (!v || load + v->demand > capacity) {
+      if (load) {
+        k = fleet_best_fit(c, counts, load);
+        if (k < 0) return 0;
+        counts[k]--;
+        capacity = fleet_largest(c, counts);
+        sequence[length++] = origin;
+      }
+      load = 0;
+      if (!v) break;
+      if (v->demand > capacity) return 0;
+    }
+    sequence[length++] = v;
+    load += v->demand;
+  }
+  return length;
+}
+
+// Polar sweep around the depot, tried from evenly spaced starting customers.
+// Needs coordinates.
+Solution *sweep_solution(Graph *g, Fleet *c, Vertice *origin) {
+  unsigned int i, v, n_customers = 0, n_starts, length, best_length = 0;
+  unsigned int *counts;
+  double cost, best_cost = INFINITY;
+  RouteKey *angles;
+  Vertice **sequence, **best_sequence;
+  Solution *s = NULL;
+
+  if (!g->x) return NULL;
+
+  angles = malloc(g->n*sizeof(RouteKey));
+  for (v = 0; v < g->n; v++) {
+    if (v == origin->id) continue;
+    angles[n_customers].key = atan2(g->y[v] - g->y[origin->id],
+                                    g->x[v] - g->x[origin->id]);
+    angles[n_customers].id = v;
+    n_customers++;
+  }
+  qsort(angles, n_customers, sizeof(RouteKey), compare_route_keys);
+
+  counts = malloc(c->n_classes*sizeof(unsigned int));
+  sequence = malloc((2*g->n + 1)*sizeof(Vertice *));
+  best_sequence = malloc((2*g->n + 1)*sizeof(Vertice *));
+  n_starts = n_customers < SWEEP_STARTS ? n_customers : SWEEP_STARTS;
+  for (i = 0; i < n_starts; i++) {
+    length = sweep_routes(g, c, origin, angles, n_customers,
+                          i*n_customers / n_starts, counts, sequence);
+    if (!length) continue;
+    cost = 0;
+    for (v = 1; v < length; v++) {
+      if (sequence[v-1] != sequence[v]) {
+        cost += graph_cost(g, sequence[v-1]->id, sequence[v]->id);
+      }
+    }
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_length = length;
+      memcpy(best_sequence, sequence, length*sizeof(Vertice *));
+    }
+  }
+  if (best_length) {
+    s = solution_from_sequence(g, c, origin, best_sequence, best_length);
+  }
+
+  free(angles);
+  free(counts);
+  free(sequence);
+  free(best_sequence);
+
+  return s;
+}
+
+// ===========================================================================
+//                                 CONSTRUCTION
+// ===========================================================================
+
+// The cheaper of the savings and sweep solutions
+Solution *construct_solution(Graph *g, Fleet *c, Vertice *origin) {
+  Solution *savings = savings_solution(g, c, origin);
+  Solution *sweep = sweep_solution(g, c, origin);
+
+  if (!sweep) return savings;
+  if (!savings) return sweep;
+  if (sweep->cost < savings->cost) {
+    destroy_solution(savings);
+    return sweep;
+  }
+  destroy_solution(sweep);
+  return savings;
+}
+
+Constructor find_constructor(const char *name) {
+  if (!strcmp(name, "savings")) return savings_solution;
+  if (!strcmp(name, "sweep")) return sweep_solution;
+  if (!strcmp(name, "best")) return construct_solution;
+  return NULL;
+}
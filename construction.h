@@ -0,0 +1,16 @@
+#ifndef CONSTRUCTION_H
+#define CONSTRUCTION_H
+
+#include "data_structures.h"
+
+// Constructive heuristics return a feasible Solution, or NULL when the
+// routes they build do not fit the fleet
+Solution *savings_solution(Graph *g, Fleet *c, Vertice *origin);
+Solution *sweep_solution(Graph *g, Fleet *c, Vertice *origin);
+Solution *construct_solution(Graph *g, Fleet *c, Vertice *origin);
+
+typedef Solution *(*Constructor)(Graph *g, Fleet *c, Vertice *origin);
+
+Constructor find_constructor(const char *name);
+
+#endif
@@ -1,6 +1,26 @@
 #!/usr/bin/env python
 
 import os
+import struct
+import sys
+
+# Writes .vrpb binary instances, which the solver maps straight into memory,
+# instead of the text format
+binary = '--binary' in sys.argv[1:]
+
+
+def write_binary(filename, demands, distances, capacity):
+    n_v = len(demands)
+    with open(filename, 'wb') as outp:
+        outp.write(struct.pack('=4sIII', b'VRPB', 1, n_v, n_v))
+        outp.write(struct.pack('=%dI' % n_v, *demands))
+        outp.write(struct.pack('=%dI' % n_v, *([capacity]*n_v)))
+        # The cost matrix starts 8-byte aligned, with zeros on the diagonal
+        outp.write(b'\0' * (-(16 + 8*n_v) % 8))
+        for i, dist_v in enumerate(distances):
+            row = dist_v[:i] + [0.0] + dist_v[i:]
+            outp.write(struct.pack('=%dd' % n_v, *row))
+
 
 for dirname, subdirlist, filelist in os.walk("./instances/A-VRP"):
     for filename in filelist:
@@ -25,6 +45,10 @@ for dirname, subdirlist, filelist in os.walk("./instances/A-VRP"):
             for i in range(n_v):
                 demand = int(lines[7+n_v+1+i][:-2].split(' ')[1])
                 demands.append(demand)
+            if binary:
+                write_binary("./instances/"+filename+'b', demands, distances,
+                             capacity)
+                continue
             with open("./instances/"+filename+'t', 'w') as outp:
                 outp.write(str(n_v)+'\n')
                 for demand in demands:
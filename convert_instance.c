@@ -0,0 +1,35 @@
+// Converts an instance in the text format (or a binary one) to the binary
+// format that read_instance maps straight into memory.
+//
+// Build: gcc -O2 -o convert_instance convert_instance.c data_structures.c -lm
+// Usage: ./convert_instance <instance> <output.vrpb>
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "data_structures.h"
+
+int main(int argc, char const *argv[]) {
+  Instance *inst;
+
+  if (argc != 3) {
+    printf("ERROR: Please specify input and output instance names.");
+    return 1;
+  }
+
+  inst = malloc(sizeof(Instance));
+  if (!read_instance(inst, argv[1])) {
+    printf("ERROR: Could not read instance %s.", argv[1]);
+    free(inst);
+    return 1;
+  }
+  if (!write_binary_instance(inst, argv[2])) {
+    printf("ERROR: Could not write instance %s.", argv[2]);
+    destroy_instance(inst);
+    return 1;
+  }
+
+  destroy_instance(inst);
+  return 0;
+}
@@ -1,7 +1,17 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "data_structures.h"
+#include "row_kernels.h"
 
 
 // ===========================================================================
@@ -16,6 +26,18 @@ static bool array_only_has_true(bool *arr, unsigned int size) {
   return true;
 }
 
+// ===========================================================================
+//                                   BITSETS                                  
+// ===========================================================================
+
+unsigned int bitset_words(unsigned int n_bits) {
+  return (n_bits + 63) / 64;
+}
+
+uint64_t *new_bitset(unsigned int n_bits) {
+  return calloc(bitset_words(n_bits), sizeof(uint64_t));
+}
+
 // ===========================================================================
 //                                  VERTICES                                 
 // ===========================================================================
@@ -272,6 +294,72 @@ Vertice *get_head(Queue *q) {
   return q->head->value;
 }
 
+// ===========================================================================
+//                                   FLEETS                                   
+// ===========================================================================
+
+static int compare_capacities(const void *a, const void *b) {
+  unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+  return (x > y) - (x < y);
+}
+
+// Groups the capacities into ascending classes of equal vehicles, so a
+// homogeneous fleet is a single class with a count
+void init_fleet(Fleet *f, unsigned int *capacities, unsigned int n) {
+  unsigned int i, *sorted = malloc(n*sizeof(unsigned int));
+
+  memcpy(sorted, capacities, n*sizeof(unsigned int));
+  qsort(sorted, n, sizeof(unsigned int), compare_capacities);
+  f->n_vehicles = n;
+  f->n_classes = 0;
+  f->capacity = malloc(n*sizeof(unsigned int));
+  f->count = malloc(n*sizeof(unsigned int));
+  for (i = 0; i < n; i++) {
+    if (!f->n_classes || f->capacity[f->n_classes-1] != sorted[i]) {
+      f->capacity[f->n_classes] = sorted[i];
+      f->count[f->n_classes++] = 0;
+    }
+    f->count[f->n_classes-1]++;
+  }
+  free(sorted);
+}
+
+void destroy_fleet(Fleet *f) {
+  if (f) {
+    free(f->capacity);
+    free(f->count);
+    free(f);
+    f = NULL;
+  }
+}
+
+// Returns the class of the smallest vehicle left in counts that holds
+// demand, or -1 when none does
+int fleet_best_fit(Fleet *f, unsigned int *counts, unsigned int demand) {
+  unsigned int low = 0, high = f->n_classes, mid;
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (f->capacity[mid] < demand) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
+    }
+  }
+  while (low < f->n_classes && !counts[low]) {
+    low++;
+  }
+  return low < f->n_classes ? (int)low : -1;
+}
+
+unsigned int fleet_largest(Fleet *f, unsigned int *counts) {
+  unsigned int i;
+  for (i = f->n_classes; i > 0; i--) {
+    if (counts[i-1]) return f->capacity[i-1];
+  }
+  return 0;
+}
+
 // ===========================================================================
 //                                    GRAPHS                                  
 // ===========================================================================
@@ -281,6 +369,17 @@ void init_graph(Graph *g, unsigned int n_vertices, Vertice **v) {
   g->v = v;
   g->n_edges = calloc(n_vertices, sizeof(unsigned int));
   g->edges = calloc(n_vertices, sizeof(Edge **));
+  g->cost = calloc(n_vertices*n_vertices, sizeof(double));
+  g->symmetric = g->packed = false;
+  g->sorted = NULL;
+  atomic_init(&g->rows_sorted, false);
+  g->edge_block = NULL;
+  g->edge_ready = NULL;
+  g->mapping = NULL;
+  g->mapping_size = 0;
+  g->x = g->y = NULL;
+  g->n_neighbours = 0;
+  g->neighbours = NULL;
 }
 
 void init_graph_edges(Graph *g, unsigned int vertice, unsigned int n_edges) {
@@ -302,11 +401,28 @@ void destroy_graph(Graph *g) {
     if (g->n_edges) {
       free(g->n_edges);
     }
+    // A mapped instance file owns the cost matrix
+    if (g->mapping) {
+      munmap(g->mapping, g->mapping_size);
+    }
+    else {
+      free(g->cost);
+    }
+    free(g->sorted);
+    free(g->edge_block);
+    free(g->edge_ready);
+    free(g->x);
+    free(g->y);
+    free(g->neighbours);
     free(g);
     g = NULL;
   }
 }
 
+// Guards filling in edges and sorting rows, which happens once per edge and
+// once per graph, so one lock serves every graph
+static pthread_mutex_t graph_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void quicksort_edges(Graph *g) {
   unsigned int i;
   for (i = 0; i < g->n; i++) {
@@ -314,117 +430,217 @@ void quicksort_edges(Graph *g) {
   }
 }
 
+// The instance reader fills g->cost, which may be a read-only mapping
+void index_graph_edges(Graph *g) {
+  unsigned int i, j;
+  for (i = 0; i < g->n; i++) {
+    for (j = 0; j < g->n_edges[i]; j++) {
+      g->sorted[i*g->n + j] = g->edges[i][j]->dest->id;
+    }
+  }
+}
+
+// Fills in the k-th edge of the block unless it already is, with
+// graph_lock held
+static Edge *fill_edge(Graph *g, size_t k, unsigned int i, unsigned int j) {
+  if (!(atomic_load_explicit(&g->edge_ready[k >> 6],
+                             memory_order_relaxed) >> (k & 63) & 1)) {
+    init_edge(&g->edge_block[k], g->v[i], g->v[j], graph_cost(g, i, j));
+    atomic_fetch_or_explicit(&g->edge_ready[k >> 6], (uint64_t)1 << (k & 63),
+                             memory_order_release);
+  }
+  return &g->edge_block[k];
+}
+
+// The edge from i to j. Local search only ever needs the few edges its
+// solutions use, so edges are filled in when first asked for.
+Edge *graph_edge(Graph *g, unsigned int i, unsigned int j) {
+  size_t k = (size_t)i*(g->n-1) + j - (j > i);
+  Edge *e;
+
+  if (atomic_load_explicit(&g->edge_ready[k >> 6],
+                           memory_order_acquire) >> (k & 63) & 1) {
+    return &g->edge_block[k];
+  }
+  pthread_mutex_lock(&graph_lock);
+  e = fill_edge(g, k, i, j);
+  pthread_mutex_unlock(&graph_lock);
+  return e;
+}
+
+// Builds the out edges of every vertex sorted by cost the first time a
+// search walks them. Only the branch and bound does, so local search on a
+// large instance never pays for sorting n rows of n.
+void sort_graph_edges(Graph *g) {
+  unsigned int i, j;
+
+  if (atomic_load_explicit(&g->rows_sorted, memory_order_acquire)) return;
+  pthread_mutex_lock(&graph_lock);
+  if (!atomic_load_explicit(&g->rows_sorted, memory_order_relaxed)) {
+    g->sorted = malloc((size_t)g->n*g->n*sizeof(unsigned int));
+    for (i = 0; i < g->n; i++) {
+      init_graph_edges(g, i, g->n-1);
+      for (j = 0; j < g->n; j++) {
+        if (j == i) continue;
+        g->edges[i][j - (j > i)] =
+          fill_edge(g, (size_t)i*(g->n-1) + j - (j > i), i, j);
+      }
+    }
+    quicksort_edges(g);
+    index_graph_edges(g);
+    atomic_store_explicit(&g->rows_sorted, true, memory_order_release);
+  }
+  pthread_mutex_unlock(&graph_lock);
+}
+
+unsigned int edge_id(Graph *g, Edge *e) {
+  return e->origin->id*g->n + e->dest->id;
+}
+
 unsigned int degree_out(Graph *g, unsigned int vertice) {
   return g->n_edges[vertice];
 }
 
 Edge **edges_out(Graph *g, unsigned int vertice) {
+  sort_graph_edges(g);
   return g->edges[vertice];
 }
 
-void bfs(Graph *g, Edge **e_ignore, unsigned int size, Edge *e,
-         Vertice *origin, bool **mark) {
-  unsigned int degree, i;
-  Vertice *current, *next;
+// Fills the cost matrix from the coordinates one row at a time, a tight
+// loop over contiguous arrays that the compiler can vectorize. A packed
+// matrix only gets the rows' entries below the diagonal.
+void fill_euclidean_costs(Graph *g) {
+  unsigned int i, j, n = g->n, length;
+  double *row, *x = g->x, *y = g->y, dx, dy;
+  for (i = 0; i < n; i++) {
+    row = g->packed ? g->cost + (size_t)i*(i-1)/2 : g->cost + (size_t)i*n;
+    length = g->packed ? i : n;
+    for (j = 0; j < length; j++) {
+      dx = x[j] - x[i];
+      dy = y[j] - y[i];
+      row[j] = sqrt(dx*dx + dy*dy);
+    }
+    if (!g->packed) row[i] = 0;
+  }
+}
+
+bool costs_symmetric(Graph *g) {
+  unsigned int i, j;
+  if (g->packed) return true;
+  for (i = 0; i < g->n; i++) {
+    for (j = 0; j < i; j++) {
+      if (g->cost[(size_t)i*g->n + j] != g->cost[(size_t)j*g->n + i]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Keeps only the strict lower triangle of a symmetric cost matrix, packed
+// in place row after row, and gives the rest back
+void pack_symmetric_costs(Graph *g) {
+  unsigned int i, j;
+  size_t k = 0;
+
+  if (g->packed || g->mapping) return;
+  for (i = 1; i < g->n; i++) {
+    for (j = 0; j < i; j++) {
+      g->cost[k++] = g->cost[(size_t)i*g->n + j];
+    }
+  }
+  g->cost = realloc(g->cost, (k ? k : 1)*sizeof(double));
+  g->packed = true;
+}
+
+void bfs(Graph *g, Tree *t, Edge *e, Vertice *origin, bool *mark,
+         Workspace *w) {
+  unsigned int degree, i, id, head = 0, tail = 0;
+  Vertice *current, *next, **queue = w->queue;
   Edge *edge, **edges;
 
-  Queue *q = malloc(sizeof(Queue));
-  init_queue(q);
-  add_tail(q, origin);
+  // Every vertex is enqueued at most once, so the queue never wraps
+  queue[tail++] = origin;
 
-  while (!q->empty) {
-    current = get_head(q);
-    q_remove_head(q);
+  while (head < tail) {
+    current = queue[head++];
     edges = edges_out(g, current->id);
     degree = degree_out(g, current->id);
     for (i = 0; i < degree; i++) {
       edge = edges[i];
       next = edge->dest;
-      if (!(*mark)[next->id]) {
-        if (in_edges_array(e_ignore, edge, size) || edge == e) continue;
-        (*mark)[next->id] = true;
-        add_tail(q, next);
+      if (!mark[next->id]) {
+        id = current->id*g->n + next->id;
+        if (edge_ignored(t, id) || edge == e) continue;
+        mark[next->id] = true;
+        queue[tail++] = next;
       }
     }
   }
-
-  destroy_queue(q);
 }
 
-void path(Graph *g, Edge **e_ignore, Vertice **v_ignore, unsigned int size,
-          Edge *e, Vertice *origin, Vertice *dest, bool **mark) {
-  unsigned int degree, i;
-  Vertice *current, *next, *mock, **paths;
+void path(Graph *g, Tree *t, Edge *e, Vertice *origin, Vertice *dest,
+          bool *mark, Workspace *w) {
+  unsigned int degree, i, id, head = 0, tail = 0;
+  Vertice *current, *next, **paths = w->paths, **queue = w->queue;
   Edge *edge, **edges;
-  Queue *q;
 
-  mock = malloc(sizeof(Vertice));
-  paths = calloc(g->n, sizeof(Vertice *));
-  for (i = 0; i < size; i++) {
-    if (v_ignore[i]) {
-      paths[v_ignore[i]->id] = mock;
-    }
+  for (i = 0; i < g->n; i++) {
+    paths[i] = bitset_test(t->visited, i) ? &w->mock : NULL;
   }
 
-  q = malloc(sizeof(Queue));
-  init_queue(q);
-  add_tail(q, origin);
+  queue[tail++] = origin;
 
-  while (!q->empty) {
-    current = get_head(q);
-    q_remove_head(q);
+  while (head < tail) {
+    current = queue[head++];
     edges = edges_out(g, current->id);
     degree = degree_out(g, current->id);
     for (i = 0; i < degree; i++) {
       edge = edges[i];
       next = edge->dest;
       if (!paths[next->id]) {
-        if (in_edges_array(e_ignore, edge, size) || edge == e) continue;
+        id = current->id*g->n + next->id;
+        if (edge_ignored(t, id) || edge == e) continue;
         paths[next->id] = current;
         if (next == dest) goto OUT;
-        add_tail(q, next);
+        queue[tail++] = next;
       }
     }
   }
 
-  OUT: destroy_queue(q);
-
-  (*mark)[origin->id] = true;
+  OUT: mark[origin->id] = true;
   for (current = dest; current != origin; current = paths[current->id]) {
-    (*mark)[current->id] = true;
+    mark[current->id] = true;
   }
-
-  free(paths);
-  destroy_vertice(mock);
 }
 
-bool strongly_connected(Graph *g, Edge **e_ignore, Vertice **v_ignore,
-                        unsigned int level, Edge *e, Vertice *origin) {
+bool strongly_connected(Graph *g, Tree *t, Edge *e, Vertice *origin,
+                        Workspace *w) {
   unsigned int i;
-  bool *mark, *smark, ret = true;
+  bool *mark = w->mark, *smark = w->smark, ret = true;
 
-  mark = calloc(g->n, sizeof(bool));
-  smark = calloc(g->n, sizeof(bool));
+  memset(mark, 0, g->n*sizeof(bool));
+  memset(smark, 0, g->n*sizeof(bool));
 
   smark[origin->id] = true;
-  for (i = 0; i < level; i++) {
-    if (v_ignore[i] && v_ignore[i]->id != e->dest->id) {
-      mark[v_ignore[i]->id] = true;
-      smark[v_ignore[i]->id] = true;
+  for (i = 0; i < g->n; i++) {
+    if (bitset_test(t->visited, i) && i != e->dest->id) {
+      mark[i] = true;
+      smark[i] = true;
     }
   }
 
   for (i = 0; i < g->n; i++) {
     if (i == origin->id) {
-      bfs(g, e_ignore, level, e, origin, &smark);
+      bfs(g, t, e, origin, smark, w);
       if (!array_only_has_true(smark, g->n)) {
         ret = false;
         break;
       }
     }
 
-    else if (!in_vertices_array(v_ignore, g->v[i], level)) {
-      path(g, e_ignore, v_ignore, level, e, g->v[i], origin, &mark);
+    else if (!bitset_test(t->visited, i)) {
+      path(g, t, e, g->v[i], origin, mark, w);
     }
   }
 
@@ -432,12 +648,210 @@ bool strongly_connected(Graph *g, Edge **e_ignore, Vertice **v_ignore,
     ret = array_only_has_true(mark, g->n);
   }
 
-  free(mark);
-  free(smark);
-
   return ret;
 }
 
+// Marks in w->reached every allowed vertex reachable from (or, if reverse,
+// reaching) origin or also start, and returns whether all allowed vertices
+// were reached
+static bool reach_allowed(Graph *g, Tree *t, unsigned int e_id,
+                          unsigned int origin, unsigned int start,
+                          bool reverse, Workspace *w) {
+  unsigned int k, c, j, id, head = 0, tail = 0;
+  unsigned int words = bitset_words(g->n), *queue = w->ids;
+  uint64_t bits, *allowed = w->allowed, *reached = w->reached;
+
+  memset(reached, 0, words*sizeof(uint64_t));
+  bitset_set(reached, origin);
+  queue[tail++] = origin;
+  if (start != origin) {
+    bitset_set(reached, start);
+    queue[tail++] = start;
+  }
+
+  while (head < tail) {
+    c = queue[head++];
+    // Only allowed vertices not reached yet are worth looking at
+    for (k = 0; k < words; k++) {
+      bits = allowed[k] & ~reached[k];
+      while (bits) {
+        j = k*64 + __builtin_ctzll(bits);
+        bits &= bits - 1;
+        id = reverse ? j*g->n + c : c*g->n + j;
+        if (id == e_id || edge_ignored(t, id)) continue;
+        bitset_set(reached, j);
+        queue[tail++] = j;
+      }
+    }
+  }
+
+  for (k = 0; k < words; k++) {
+    if (allowed[k] & ~reached[k]) return false;
+  }
+  return true;
+}
+
+bool residual_connected(Graph *g, Tree *t, Edge *e, Vertice *origin,
+                        Workspace *w) {
+  unsigned int i, words = bitset_words(g->n), e_id = edge_id(g, e);
+  unsigned int head = t->current_v->id;
+  bool ret, relevant, customers = false;
+
+  // An edge leaving a visited customer is not part of the residual graph
+  // seen from the depot, so removing it cannot undo a yes from the depot.
+  // A no may have needed the route's end, whose edges it can remove.
+  relevant = e->origin == origin || !bitset_test(t->visited, e->origin->id);
+  if (!relevant && t->residual_known && t->residual_ok) return true;
+
+  for (i = 0; i < words; i++) {
+    w->allowed[i] = ~t->visited[i];
+  }
+  if (g->n % 64) {
+    w->allowed[words-1] &= ((uint64_t)1 << (g->n % 64)) - 1;
+  }
+  bitset_set(w->allowed, origin->id);
+  bitset_set(w->allowed, e->dest->id);
+  for (i = 0; i < g->n && !customers; i++) {
+    customers = i != origin->id && bitset_test(w->allowed, i);
+  }
+  if (!customers) return false;
+
+  // Every customer left must be reachable, by a new route from the depot
+  // or by the one being built, and reach the depot back
+  ret = reach_allowed(g, t, e_id, origin->id, origin->id, false, w);
+  if (ret || head == origin->id) {
+    ret = ret && reach_allowed(g, t, e_id, origin->id, origin->id, true, w);
+    if (!relevant) {
+      t->residual_known = true;
+      t->residual_ok = ret;
+    }
+    return ret;
+  }
+
+  // Customers the depot cannot reach any more may still be reached from the
+  // end of the route being built, which depends on its edges left
+  return reach_allowed(g, t, e_id, origin->id, head, false, w) &&
+         reach_allowed(g, t, e_id, origin->id, origin->id, true, w);
+}
+
+// ===========================================================================
+//                               NEIGHBOUR LISTS                              
+// ===========================================================================
+
+static bool closer_neighbour(Graph *g, unsigned int v, unsigned int a,
+                             unsigned int b) {
+  double cost_a = graph_cost(g, v, a), cost_b = graph_cost(g, v, b);
+  return cost_a < cost_b || (cost_a == cost_b && a < b);
+}
+
+// Inserts u into the list of v, which holds the count closest so far
+static void offer_neighbour(Graph *g, unsigned int v, unsigned int u,
+                            unsigned int *count) {
+  unsigned int k = g->n_neighbours, pos;
+  unsigned int *list = g->neighbours + (size_t)v*k;
+
+  if (*count == k && !closer_neighbour(g, v, u, list[k-1])) return;
+  pos = *count < k ? (*count)++ : k - 1;
+  while (pos > 0 && closer_neighbour(g, v, u, list[pos-1])) {
+    list[pos] = list[pos-1];
+    pos--;
+  }
+  list[pos] = u;
+}
+
+static unsigned int grid_cell(double value, double low, double width,
+                              unsigned int side) {
+  unsigned int cell = (unsigned int)((value - low) / width);
+  return cell < side ? cell : side - 1;
+}
+
+// Finds the k nearest vertices of every vertex through a uniform grid of
+// about two vertices per cell, scanning rings of cells outwards until no
+// closer vertex can remain. Without coordinates every vertex is offered to
+// every list, which keeps the k nearest without sorting whole rows.
+void build_neighbour_lists(Graph *g, unsigned int k) {
+  unsigned int i, v, u, r, cx, cy, x, y, count, side, n_cells;
+  unsigned int *start, *items, *cell_of;
+  double low_x, low_y, high_x, high_y, width, height, reach;
+
+  if (k > g->n - 1) k = g->n - 1;
+  g->n_neighbours = k;
+  g->neighbours = malloc((size_t)g->n*k*sizeof(unsigned int));
+  if (!k) return;
+
+  if (!g->x) {
+    for (v = 0; v < g->n; v++) {
+      count = 0;
+      for (u = 0; u < g->n; u++) {
+        if (u != v) offer_neighbour(g, v, u, &count);
+      }
+    }
+    return;
+  }
+
+  low_x = high_x = g->x[0];
+  low_y = high_y = g->y[0];
+  for (v = 1; v < g->n; v++) {
+    if (g->x[v] < low_x) low_x = g->x[v];
+    if (g->x[v] > high_x) high_x = g->x[v];
+    if (g->y[v] < low_y) low_y = g->y[v];
+    if (g->y[v] > high_y) high_y = g->y[v];
+  }
+  side = (unsigned int)ceil(sqrt(g->n / 2.0));
+  width = high_x > low_x ? (high_x - low_x) / side : 1;
+  height = high_y > low_y ? (high_y - low_y) / side : 1;
+  reach = width < height ? width : height;
+
+  // Counting sort of the vertices by cell
+  n_cells = side*side;
+  start = calloc(n_cells + 1, sizeof(unsigned int));
+  items = malloc(g->n*sizeof(unsigned int));
+  cell_of = malloc(g->n*sizeof(unsigned int));
+  for (v = 0; v < g->n; v++) {
+    cell_of[v] = grid_cell(g->y[v], low_y, height, side)*side +
+                 grid_cell(g->x[v], low_x, width, side);
+    start[cell_of[v] + 1]++;
+  }
+  for (i = 0; i < n_cells; i++) {
+    start[i + 1] += start[i];
+  }
+  for (v = 0; v < g->n; v++) {
+    items[start[cell_of[v]]++] = v;
+  }
+  for (i = n_cells; i > 0; i--) {
+    start[i] = start[i - 1];
+  }
+  start[0] = 0;
+
+  for (v = 0; v < g->n; v++) {
+    cx = cell_of[v] % side;
+    cy = cell_of[v] / side;
+    count = 0;
+    for (r = 0; r < side; r++) {
+      // Cells r rings out are at least r - 1 cell widths away
+      if (count == k && r > 0 &&
+          graph_cost(g, v, g->neighbours[(size_t)v*k + k-1]) <= (r-1)*reach) {
+        break;
+      }
+      for (y = cy > r ? cy - r : 0; y <= cy + r && y < side; y++) {
+        for (x = cx > r ? cx - r : 0; x <= cx + r && x < side; x++) {
+          if (y + r != cy && y != cy + r && x + r != cx && x != cx + r) {
+            continue;
+          }
+          for (i = start[y*side + x]; i < start[y*side + x + 1]; i++) {
+            u = items[i];
+            if (u != v) offer_neighbour(g, v, u, &count);
+          }
+        }
+      }
+    }
+  }
+
+  free(start);
+  free(items);
+  free(cell_of);
+}
+
 // ===========================================================================
 //                                  SOLUTIONS                                 
 // ===========================================================================
@@ -458,66 +872,97 @@ void destroy_solution(Solution *s) {
   }
 }
 
+// Formats the path first so the solution is written in one call
 void print_solution(Solution *s) {
   unsigned int i;
-  if (s) {
-    printf("Solution cost: %f\n", s->cost);
-    printf("Solution path: ");
-    for (i = 0; i < s->n_edges; i++) {
-      if (s->edges[i]) {
-        printf("%d ", s->edges[i]->dest->id);
-      }
-    }
-    printf("0\n\n");
-  } else  {
+  size_t length = 0;
+  char *path;
+
+  if (!s) {
     printf("No solution!\n");
+    return;
   }
+  path = malloc(12*(size_t)s->n_edges + 1);
+  path[0] = '\0';
+  for (i = 0; i < s->n_edges; i++) {
+    if (s->edges[i]) {
+      length += sprintf(path + length, "%u ", s->edges[i]->dest->id);
+    }
+  }
+  printf("Solution cost: %f\nSolution path: %s0\n\n", s->cost, path);
+  free(path);
 }
 
 bool build_solution_from_sequence(Solution *s, Vertice **sequence, Graph *g,
-                                  IntLinkedList *c, Vertice *origin) {
+                                  Fleet *c, Vertice *origin) {
   bool ret = true;
-  unsigned int i, j, id_src, id_dest, degree, demand, it_s = 0;
-  Edge *edge, **out_edges;
-  IntLinkedList *vehicles = deep_copy(c);
+  unsigned int i, id_src, id_dest, demand, it_s = 0;
+  unsigned int vehicles[c->n_classes];
+  int k;
+  Edge *edge;
+
+  memcpy(vehicles, c->count, c->n_classes*sizeof(unsigned int));
 
   demand = 0;
   for (i = 0; i < s->n_edges; i++) {
     id_src = sequence[i]->id;
     id_dest = sequence[i+1]->id;
     if (id_src == id_dest) continue;
-    out_edges = edges_out(g, id_src);
-    degree = degree_out(g, id_src);
-    for (j = 0; j < degree; j++) {
-      if (out_edges[j]->dest->id == id_dest) {
-        edge = out_edges[j];
-        break;
-      }
-    }
+    edge = graph_edge(g, id_src, id_dest);
     s->edges[it_s] = edge;
     it_s++;
     s->cost += edge->cost;
     demand += edge->dest->demand;
     if (edge->dest == origin) {
-      if (!remove_value(vehicles, demand)) {
+      k = fleet_best_fit(c, vehicles, demand);
+      if (k < 0) {
         ret = false;
         break;
       }
+      vehicles[k]--;
       demand = 0;
     }
   }
 
-  destroy_linkedlist(vehicles);
-
   return ret;
 }
 
+Solution *copy_solution(Solution *s) {
+  Solution *copy = malloc(sizeof(Solution));
+  init_solution(copy, s->n_edges);
+  memcpy(copy->edges, s->edges, s->n_edges*sizeof(Edge *));
+  copy->cost = s->cost;
+  return copy;
+}
+
+// Writes the n_edges + 1 vertices s walks through, depot first. Branch and
+// bound lists the edges from the last one back, sequences list them in order.
+void build_sequence_from_solution(Solution *s, Vertice **sequence,
+                                  Vertice *origin) {
+  unsigned int i, n_edges = s->n_edges;
+
+  if (s->edges[0]->origin == origin) {
+    for (i = 0; i < n_edges && s->edges[i]; i++) {
+      sequence[i] = s->edges[i]->origin;
+    }
+    sequence[i] = origin;
+    for (i++; i <= n_edges; i++) {
+      sequence[i] = origin;
+    }
+    return;
+  }
+  for (i = 0; i < n_edges; i++) {
+    sequence[i] = s->edges[n_edges-1 - i]->origin;
+  }
+  sequence[n_edges] = s->edges[0]->dest;
+}
+
 // ===========================================================================
 //                                    TREES                                   
 // ===========================================================================
 
 void init_tree(Tree *t, Vertice *v, Edge *e, bool e_v, Tree *p,
-               IntLinkedList *ll, Vertice *origin, Graph *g) {
+               Fleet *fleet, Vertice *origin, Graph *g) {
   t->current_v = v;
   t->current_e = e;
   t->edge_value = e_v;
@@ -528,10 +973,18 @@ void init_tree(Tree *t, Vertice *v, Edge *e, bool e_v, Tree *p,
   t->n_vertices_traversed = 1;
   t->cost_so_far = 0;
   t->path_demand_so_far = 0;
-  t->available_vehicles = ll;
-  t->removed_vehicle = false;
-  t->lower_bound = get_lower_bound(t, g, origin);
-  t->upper_bound = get_upper_bound(t, g, origin);
+  memcpy(t->vehicle_counts, fleet->count,
+         fleet->n_classes*sizeof(unsigned int));
+  t->vehicles = t->vehicle_counts;
+  t->largest_vehicle = fleet_largest(fleet, t->vehicles);
+  t->prefix = NULL;
+  t->n_prefix = 0;
+  t->route_first = NULL;
+  t->state_hash = t->head_hash = 0;
+  t->residual_known = t->residual_ok = false;
+  init_tree_sets(t, g);
+  init_bound_state(t, g);
+  get_bounds(t, g, &t->lower_bound, &t->upper_bound);
 }
 
 void init_tree_from_parent(Tree *t, Tree *other, Vertice *v, Edge *e,
@@ -546,10 +999,21 @@ void init_tree_from_parent(Tree *t, Tree *other, Vertice *v, Edge *e,
   t->n_vertices_traversed = other->n_vertices_traversed + (e_v*(v != origin));
   t->cost_so_far = other->cost_so_far + (e_v*(e->cost));
   t->path_demand_so_far = other->path_demand_so_far + (e_v*(v->demand));
-  t->available_vehicles = other->available_vehicles;
-  t->removed_vehicle = false;
-  t->lower_bound = get_lower_bound(t, g, origin);
-  t->upper_bound = get_upper_bound(t, g, origin);
+  // Vehicles are shared with the parent until this node takes one
+  t->vehicles = other->vehicles;
+  t->largest_vehicle = other->largest_vehicle;
+  t->prefix = NULL;
+  t->n_prefix = 0;
+  t->route_first = e_v && e->origin == origin ? v : other->route_first;
+  // The search folds the decision into the hashes
+  t->state_hash = other->state_hash;
+  t->head_hash = other->head_hash;
+  // Excluding an edge of a visited customer leaves the residual graph as is
+  t->residual_known = !e_v && e->origin != origin && other->residual_known;
+  t->residual_ok = other->residual_ok;
+  update_tree_sets(t, other, g, origin);
+  update_bound_state(t, other, g, origin);
+  get_bounds(t, g, &t->lower_bound, &t->upper_bound);
 }
 
 void destroy_tree(Tree *t) {
@@ -559,77 +1023,88 @@ void destroy_tree(Tree *t) {
   if (t->right_child) {
     destroy_tree(t->right_child);
   }
-  if (t->removed_vehicle) {
-    destroy_linkedlist(t->available_vehicles);
+  free(t->prefix);
+  if (t->pool) {
+    pool_release_tree(t->pool, t);
+  }
+  else {
+    free(t);
   }
-  free(t);
   t = NULL;
 }
 
 double get_lower_bound(Tree *t, Graph *g, Vertice *origin) {
-  unsigned int i, j, degree;
-  double *out;
-  Edge *edge, **out_edges, **e_ignore;
+  double lower, upper;
+  get_bounds(t, g, &lower, &upper);
+  return lower;
+}
 
-  out = calloc(g->n, sizeof(double));
-  e_ignore = calloc(t->level, sizeof(Edge *));
+double get_upper_bound(Tree *t, Graph *g, Vertice *origin) {
+  double lower, upper;
+  get_bounds(t, g, &lower, &upper);
+  return upper;
+}
 
-  build_traversed_edges_in_out(t, origin, e_ignore, out);
+// Vertices without a chosen out edge use their cheapest allowed one for the
+// lower bound and their most expensive one for the upper bound
+void get_bounds(Tree *t, Graph *g, double *lower, double *upper) {
+  masked_row_sums(t->out_cost, t->min_cost, t->max_cost, g->n, lower, upper);
+}
 
-  for (i = 0; i < g->n; i++) {
-    if (out[i]) continue;
-    out_edges = edges_out(g, i);
-    degree = degree_out(g, i);
-    for (j = 0; j < degree; j++) {
-      edge = out_edges[j];
-      if (in_edges_array(e_ignore, edge, t->level)) continue;
-      out[i] = edge->cost;
-      break;
-    }
-  }
+// The cost of the out edge of i at cursor in g->sorted order, 0 when there
+// is none. Out edges carry their cost, whichever way the matrix is stored.
+double cursor_cost(Graph *g, unsigned int i, unsigned int cursor) {
+  return cursor < g->n_edges[i] ? g->edges[i][cursor]->cost : 0;
+}
 
-  double result = 0;
+void init_bound_state(Tree *t, Graph *g) {
+  unsigned int i;
+
+  sort_graph_edges(g);
+  memset(t->out_cost, 0, g->n*sizeof(double));
+  memset(t->min_cursor, 0, g->n*sizeof(unsigned int));
   for (i = 0; i < g->n; i++) {
-    result += out[i];
+    t->max_cursor[i] = degree_out(g, i);
+    t->min_cost[i] = cursor_cost(g, i, 0);
+    t->max_cost[i] = t->max_cursor[i] > 0 ?
+                     cursor_cost(g, i, t->max_cursor[i]-1) : 0;
   }
-
-  free(out);
-  free(e_ignore);
-
-  return result;
 }
 
-double get_upper_bound(Tree *t, Graph *g, Vertice *origin) {
-  unsigned int i, j, degree;
-  double *out;
-  Edge *edge, **out_edges, **e_ignore;
-
-  out = calloc(g->n, sizeof(double));
-  e_ignore = calloc(t->level, sizeof(Edge *));
+void update_bound_state(Tree *t, Tree *other, Graph *g, Vertice *origin) {
+  unsigned int id, degree, *row;
+  Edge *e = t->current_e;
 
-  build_traversed_edges_in_out(t, origin, e_ignore, out);
+  memcpy(t->out_cost, other->out_cost, g->n*sizeof(double));
+  memcpy(t->min_cursor, other->min_cursor, g->n*sizeof(unsigned int));
+  memcpy(t->max_cursor, other->max_cursor, g->n*sizeof(unsigned int));
+  memcpy(t->min_cost, other->min_cost, g->n*sizeof(double));
+  memcpy(t->max_cost, other->max_cost, g->n*sizeof(double));
 
-  for (i = 0; i < g->n; i++) {
-    if (out[i]) continue;
-    out_edges = edges_out(g, i);
-    degree = degree_out(g, i);
-    for (j = 0; j < degree; j++) {
-      edge = out_edges[degree-1 - j];
-      if (in_edges_array(e_ignore, edge, t->level)) continue;
-      out[i] = edge->cost;
-      break;
-    }
+  id = e->origin->id;
+  if (t->edge_value && (e->origin == origin || !t->out_cost[id])) {
+    t->out_cost[id] += e->cost;
   }
 
-  double result = 0;
-  for (i = 0; i < g->n; i++) {
-    result += out[i];
+  // Parent cursors point at allowed edges, so only a cursor sitting on the
+  // newly ignored edge has to move
+  row = g->sorted + id*g->n;
+  degree = degree_out(g, id);
+  if (t->min_cursor[id] < degree && row[t->min_cursor[id]] == e->dest->id) {
+    do {
+      t->min_cursor[id]++;
+    } while (t->min_cursor[id] < degree &&
+             edge_ignored(t, id*g->n + row[t->min_cursor[id]]));
+    t->min_cost[id] = cursor_cost(g, id, t->min_cursor[id]);
+  }
+  if (t->max_cursor[id] > 0 && row[t->max_cursor[id]-1] == e->dest->id) {
+    do {
+      t->max_cursor[id]--;
+    } while (t->max_cursor[id] > 0 &&
+             edge_ignored(t, id*g->n + row[t->max_cursor[id]-1]));
+    t->max_cost[id] = t->max_cursor[id] > 0 ?
+                      cursor_cost(g, id, t->max_cursor[id]-1) : 0;
   }
-
-  free(out);
-  free(e_ignore);
-
-  return result;
 }
 
 void add_child_to_parent(Tree *parent, Tree *child) {
@@ -687,15 +1162,22 @@ void build_traversed_edges_in_out(Tree *t, Vertice *origin, Edge **e_ignore,
 void build_solution(Tree *t, Solution *s) {
   Tree *iterator = t;
   init_solution(s, t->edges_count);
-  unsigned int it_s = 0;
+  unsigned int i, it_s = 0;
   while (iterator->level > 0) {
     if (iterator->edge_value) {
       s->cost += iterator->current_e->cost;
       s->edges[it_s] = iterator->current_e;
       it_s++;
     }
+    if (!iterator->parent) break;
     iterator = iterator->parent;
   }
+  // Detached subtrees remember the edges chosen above them
+  for (i = 0; i < iterator->n_prefix; i++) {
+    s->cost += iterator->prefix[i]->cost;
+    s->edges[it_s] = iterator->prefix[i];
+    it_s++;
+  }
 }
 
 void next_leaf(Tree **current) {
@@ -726,3 +1208,592 @@ void next_leaf(Tree **current) {
     *current = aux;
   }
 }
+
+void release_leaf(Tree *t) {
+  Tree *aux = t, *parent;
+  while (aux && !aux->left_child && !aux->right_child) {
+    parent = aux->parent;
+    if (parent) {
+      if (parent->left_child == aux) {
+        parent->left_child = NULL;
+      }
+      else {
+        parent->right_child = NULL;
+      }
+    }
+    destroy_tree(aux);
+    aux = parent;
+  }
+}
+
+void init_tree_sets(Tree *t, Graph *g) {
+  unsigned int e_words = bitset_words(g->n*g->n);
+  unsigned int v_words = bitset_words(g->n);
+
+  memset(t->excluded, 0, e_words*sizeof(uint64_t));
+  memset(t->included, 0, e_words*sizeof(uint64_t));
+  memset(t->visited, 0, v_words*sizeof(uint64_t));
+}
+
+void update_tree_sets(Tree *t, Tree *other, Graph *g, Vertice *origin) {
+  unsigned int e_words = bitset_words(g->n*g->n);
+  unsigned int v_words = bitset_words(g->n);
+
+  memcpy(t->excluded, other->excluded, e_words*sizeof(uint64_t));
+  memcpy(t->included, other->included, e_words*sizeof(uint64_t));
+  memcpy(t->visited, other->visited, v_words*sizeof(uint64_t));
+
+  if (t->edge_value) {
+    bitset_set(t->included, edge_id(g, t->current_e));
+  }
+  else {
+    bitset_set(t->excluded, edge_id(g, t->current_e));
+  }
+  if (t->current_v != origin) {
+    bitset_set(t->visited, t->current_v->id);
+  }
+}
+
+bool edge_ignored(Tree *t, unsigned int id) {
+  return bitset_test(t->excluded, id) || bitset_test(t->included, id);
+}
+
+// ===========================================================================
+//                                 TREE POOLS                                 
+// ===========================================================================
+
+static size_t tree_header_size(void) {
+  return (sizeof(Tree) + 7) & ~(size_t)7;
+}
+
+// Points the per-vertex arrays and bitsets of t at the memory following it
+static void layout_tree(TreePool *p, Tree *t) {
+  unsigned int e_words = bitset_words(p->n*p->n);
+  unsigned int v_words = bitset_words(p->n);
+  char *it = (char *)t + tree_header_size();
+
+  t->out_cost = (double *)it;
+  it += p->n*sizeof(double);
+  t->min_cost = (double *)it;
+  it += p->n*sizeof(double);
+  t->max_cost = (double *)it;
+  it += p->n*sizeof(double);
+  t->duals = (double *)it;
+  it += 2*p->n*sizeof(double);
+  t->excluded = (uint64_t *)it;
+  it += e_words*sizeof(uint64_t);
+  t->included = (uint64_t *)it;
+  it += e_words*sizeof(uint64_t);
+  t->visited = (uint64_t *)it;
+  it += v_words*sizeof(uint64_t);
+  t->min_cursor = (unsigned int *)it;
+  it += p->n*sizeof(unsigned int);
+  t->max_cursor = (unsigned int *)it;
+  it += p->n*sizeof(unsigned int);
+  t->assign = (unsigned int *)it;
+  it += p->n*sizeof(unsigned int);
+  t->vehicle_counts = (unsigned int *)it;
+}
+
+// Copies the search state of src into dst, leaving dst unlinked
+static void copy_tree(TreePool *p, Tree *dst, Tree *src) {
+  unsigned int *min_cursor = dst->min_cursor, *max_cursor = dst->max_cursor;
+  uint64_t *excluded = dst->excluded, *included = dst->included;
+  uint64_t *visited = dst->visited;
+  double *out_cost = dst->out_cost, *duals = dst->duals;
+  double *min_cost = dst->min_cost, *max_cost = dst->max_cost;
+  unsigned int *assign = dst->assign, *vehicle_counts = dst->vehicle_counts;
+  TreePool *pool = dst->pool;
+
+  *dst = *src;
+  dst->out_cost = out_cost;
+  dst->min_cursor = min_cursor;
+  dst->max_cursor = max_cursor;
+  dst->min_cost = min_cost;
+  dst->max_cost = max_cost;
+  dst->excluded = excluded;
+  dst->included = included;
+  dst->visited = visited;
+  dst->duals = duals;
+  dst->assign = assign;
+  dst->vehicle_counts = vehicle_counts;
+  if (src->vehicles == src->vehicle_counts) {
+    dst->vehicles = vehicle_counts;
+  }
+  dst->pool = pool;
+  dst->parent = dst->left_child = dst->right_child = NULL;
+  memcpy((char *)dst + tree_header_size(), (char *)src + tree_header_size(),
+         p->stride - tree_header_size());
+}
+
+void init_tree_pool(TreePool *p, Graph *g, Fleet *fleet,
+                    unsigned int capacity) {
+  unsigned int e_words = bitset_words(g->n*g->n);
+  unsigned int v_words = bitset_words(g->n);
+  size_t stride;
+
+  // Node header followed by its per-vertex arrays and bitsets, 8-byte aligned
+  stride = tree_header_size();
+  stride += 5*g->n*sizeof(double);
+  stride += (2*e_words + v_words)*sizeof(uint64_t);
+  stride += (3*g->n + fleet->n_classes)*sizeof(unsigned int);
+  stride = (stride + 7) & ~(size_t)7;
+
+  p->n = g->n;
+  p->n_classes = fleet->n_classes;
+  p->stride = stride;
+  p->capacity = capacity;
+  p->allocated = 0;
+  p->in_use = 0;
+  p->n_chunks = 0;
+  p->chunks = NULL;
+  p->free_list = NULL;
+}
+
+void destroy_tree_pool(TreePool *p) {
+  unsigned int i;
+  if (p) {
+    for (i = 0; i < p->n_chunks; i++) {
+      free(p->chunks[i]);
+    }
+    free(p->chunks);
+    free(p);
+    p = NULL;
+  }
+}
+
+static void grow_tree_pool(TreePool *p) {
+  unsigned int i, count;
+  char *chunk;
+  Tree *t;
+
+  // Chunks double in size, so a search only grows the pool O(log n) times
+  count = p->allocated ? p->allocated : 64;
+  if (count > p->capacity - p->allocated) {
+    count = p->capacity - p->allocated;
+  }
+  chunk = malloc(count*p->stride);
+  p->chunks = realloc(p->chunks, (p->n_chunks + 1)*sizeof(char *));
+  p->chunks[p->n_chunks++] = chunk;
+  p->allocated += count;
+
+  for (i = 0; i < count; i++) {
+    t = (Tree *)(chunk + i*p->stride);
+    layout_tree(p, t);
+    t->pool = p;
+    t->left_child = p->free_list;
+    p->free_list = t;
+  }
+}
+
+Tree *pool_get_tree(TreePool *p) {
+  Tree *t;
+  if (!p->free_list) {
+    if (p->allocated >= p->capacity) return NULL;
+    grow_tree_pool(p);
+  }
+  t = p->free_list;
+  p->free_list = t->left_child;
+  p->in_use++;
+  return t;
+}
+
+void pool_release_tree(TreePool *p, Tree *t) {
+  t->left_child = p->free_list;
+  p->free_list = t;
+  p->in_use--;
+}
+
+Tree *detach_tree(Tree *t) {
+  unsigned int n_prefix = 0;
+  TreePool *p = t->pool;
+  Tree *iterator, *d = malloc(p->stride);
+
+  layout_tree(p, d);
+  d->pool = NULL;
+  copy_tree(p, d, t);
+
+  // Included edges above t, leaf to root, as build_solution lists them
+  d->prefix = calloc(t->edges_count, sizeof(Edge *));
+  iterator = t;
+  while (iterator->parent) {
+    iterator = iterator->parent;
+    if (iterator->level == 0) break;
+    if (iterator->edge_value) {
+      d->prefix[n_prefix++] = iterator->current_e;
+    }
+  }
+  if (iterator->n_prefix) {
+    memcpy(d->prefix + n_prefix, iterator->prefix,
+           iterator->n_prefix*sizeof(Edge *));
+    n_prefix += iterator->n_prefix;
+  }
+  d->n_prefix = n_prefix;
+
+  // Ancestors may own the vehicle counts, so the detached node gets its own
+  memcpy(d->vehicle_counts, t->vehicles, p->n_classes*sizeof(unsigned int));
+  d->vehicles = d->vehicle_counts;
+
+  return d;
+}
+
+Tree *adopt_tree(TreePool *p, Tree *detached) {
+  Tree *t = pool_get_tree(p);
+  copy_tree(p, t, detached);
+  free(detached);
+  return t;
+}
+
+// ===========================================================================
+//                                 WORKSPACES                                 
+// ===========================================================================
+
+void init_workspace(Workspace *w, Graph *g, Fleet *fleet) {
+  // A depth-first search keeps at most two open children per decided edge
+  w->pool = malloc(sizeof(TreePool));
+  init_tree_pool(w->pool, g, fleet, 2*g->n*g->n + 1);
+  w->mark = calloc(g->n, sizeof(bool));
+  w->smark = calloc(g->n, sizeof(bool));
+  w->paths = calloc(g->n, sizeof(Vertice *));
+  w->queue = calloc(g->n, sizeof(Vertice *));
+  init_vertice(&w->mock, g->n, 0);
+  w->allowed = new_bitset(g->n);
+  w->reached = new_bitset(g->n);
+  w->ids = calloc(g->n, sizeof(unsigned int));
+  // Bound engines index one column past the vertices as a virtual start
+  w->slack = calloc(g->n + 1, sizeof(double));
+  w->link = calloc(g->n + 1, sizeof(unsigned int));
+  w->owner = calloc(g->n + 1, sizeof(unsigned int));
+  w->members = calloc(g->n + 1, sizeof(unsigned int));
+  w->done = calloc(g->n + 1, sizeof(bool));
+}
+
+static void free_workspace_buffers(Workspace *w) {
+  destroy_tree_pool(w->pool);
+  free(w->mark);
+  free(w->smark);
+  free(w->paths);
+  free(w->queue);
+  free(w->allowed);
+  free(w->reached);
+  free(w->ids);
+  free(w->slack);
+  free(w->link);
+  free(w->owner);
+  free(w->members);
+  free(w->done);
+}
+
+void destroy_workspace(Workspace *w) {
+  if (w) {
+    free_workspace_buffers(w);
+    free(w);
+    w = NULL;
+  }
+}
+
+// Readies a workspace that served another search for one on g. Its buffers
+// and pooled nodes are kept when g has as many vertices and the fleet as
+// many classes, and reallocated otherwise.
+void fit_workspace(Workspace *w, Graph *g, Fleet *fleet) {
+  if (w->pool->n == g->n && w->pool->n_classes == fleet->n_classes) {
+    w->pool->capacity = 2*g->n*g->n + 1;
+    return;
+  }
+  free_workspace_buffers(w);
+  init_workspace(w, g, fleet);
+}
+
+// ===========================================================================
+//                                  INSTANCES                                 
+// ===========================================================================
+
+// Binary instances hold this header, the demands, the vehicle capacities,
+// padding to 8 bytes and the row-major cost matrix, all in host byte order
+#define BINARY_MAGIC "VRPB"
+#define BINARY_VERSION 1
+
+typedef struct BinaryHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t n;
+  uint32_t n_vehicles;
+} BinaryHeader;
+
+static size_t binary_cost_offset(uint32_t n, uint32_t n_vehicles) {
+  size_t offset = sizeof(BinaryHeader) +
+                  ((size_t)n + n_vehicles)*sizeof(uint32_t);
+  return (offset + 7) & ~(size_t)7;
+}
+
+// Candidate list length for neighbourhood-restricted moves
+#define NEIGHBOUR_LIST_SIZE 16
+
+static void init_instance_vertices(Instance *inst, unsigned int n_v) {
+  unsigned int i;
+  inst->n = n_v;
+  inst->n_edges = (n_v * n_v) - n_v;
+  inst->vertices = malloc(n_v*sizeof(Vertice *));
+  // One block for all vertices, as for edges
+  inst->vertex_block = malloc(n_v*sizeof(Vertice));
+  for (i = 0; i < n_v; i++) {
+    inst->vertices[i] = &inst->vertex_block[i];
+  }
+  inst->g = malloc(sizeof(Graph));
+  init_graph(inst->g, n_v, inst->vertices);
+}
+
+// Makes room for an edge for every ordered pair of vertices, filled in from
+// the cost matrix already in the graph as graph_edge and sort_graph_edges
+// need them. The block's pages are only touched for edges in use.
+static void build_instance_edges(Instance *inst) {
+  unsigned int i, n_v = inst->n;
+  Graph *g = inst->g;
+
+  g->symmetric = costs_symmetric(g);
+  if (g->symmetric) pack_symmetric_costs(g);
+  for (i = 0; i < n_v; i++) {
+    g->n_edges[i] = n_v-1;
+  }
+  // One block for all edges rather than an allocation per pair
+  g->edge_block = calloc(inst->n_edges, sizeof(Edge));
+  g->edge_ready = calloc((inst->n_edges + 63)/64, sizeof(uint64_t));
+  build_neighbour_lists(g, NEIGHBOUR_LIST_SIZE);
+}
+
+static bool read_text_instance(Instance *inst, FILE *file) {
+  unsigned int i, j, n_v, *capacities;
+  size_t bufsize = 32;
+  char *buffer;
+  Graph *g;
+
+  buffer = malloc(bufsize*sizeof(char));
+  getline(&buffer, &bufsize, file);
+  n_v = atoi(buffer);
+  init_instance_vertices(inst, n_v);
+  g = inst->g;
+
+  for (i = 0; i < n_v; i++) {
+    getline(&buffer, &bufsize, file);
+    init_vertice(inst->vertices[i], i, atoi(buffer));
+  }
+  for (i = 0; i < n_v; i++) {
+    for (j = 0; j < n_v; j++) {
+      if (i == j) continue;
+      getline(&buffer, &bufsize, file);
+      g->cost[i*n_v + j] = atof(buffer);
+    }
+  }
+  build_instance_edges(inst);
+
+  capacities = malloc(n_v*sizeof(unsigned int));
+  for (i = 0; i < n_v; i++) {
+    getline(&buffer, &bufsize, file);
+    capacities[i] = atoi(buffer);
+  }
+  inst->vehicles = malloc(sizeof(Fleet));
+  init_fleet(inst->vehicles, capacities, n_v);
+
+  free(capacities);
+  free(buffer);
+  return true;
+}
+
+// Reads a CVRPLIB file with Euclidean coordinates. Distances stay
+// unrounded and every vertex brings a vehicle, as with convert_augerat.py,
+// and the first vertex is the depot.
+static bool read_coordinate_instance(Instance *inst, FILE *file) {
+  unsigned int i, id, n_v = 0, capacity = 0, *demands = NULL;
+  size_t bufsize = 128;
+  char *buffer, *value;
+  double *x = NULL, *y = NULL;
+  Graph *g;
+
+  buffer = malloc(bufsize*sizeof(char));
+  while (getline(&buffer, &bufsize, file) > 0) {
+    value = strchr(buffer, ':');
+    if (!strncmp(buffer, "DIMENSION", 9) && value) {
+      n_v = atoi(value + 1);
+    }
+    else if (!strncmp(buffer, "CAPACITY", 8) && value) {
+      capacity = atoi(value + 1);
+    }
+    else if (!strncmp(buffer, "NODE_COORD_SECTION", 18) && n_v) {
+      x = malloc(n_v*sizeof(double));
+      y = malloc(n_v*sizeof(double));
+      for (i = 0; i < n_v && getline(&buffer, &bufsize, file) > 0; i++) {
+        sscanf(buffer, "%u %lf %lf", &id, &x[i], &y[i]);
+      }
+    }
+    else if (!strncmp(buffer, "DEMAND_SECTION", 14) && n_v) {
+      demands = calloc(n_v, sizeof(unsigned int));
+      for (i = 0; i < n_v && getline(&buffer, &bufsize, file) > 0; i++) {
+        sscanf(buffer, "%u %u", &id, &demands[i]);
+      }
+    }
+  }
+  free(buffer);
+  if (!x || !demands) {
+    free(x);
+    free(y);
+    free(demands);
+    return false;
+  }
+
+  init_instance_vertices(inst, n_v);
+  g = inst->g;
+  for (i = 0; i < n_v; i++) {
+    init_vertice(inst->vertices[i], i, demands[i]);
+  }
+  g->x = x;
+  g->y = y;
+  // Euclidean costs are symmetric, so the full matrix is never filled
+  free(g->cost);
+  g->cost = malloc(((size_t)n_v*(n_v-1)/2 + 1)*sizeof(double));
+  g->symmetric = g->packed = true;
+  fill_euclidean_costs(g);
+  build_instance_edges(inst);
+
+  // demands is no longer needed, so it holds the capacities
+  for (i = 0; i < n_v; i++) {
+    demands[i] = capacity;
+  }
+  inst->vehicles = malloc(sizeof(Fleet));
+  init_fleet(inst->vehicles, demands, n_v);
+
+  free(demands);
+  return true;
+}
+
+// Whether the fleet and n by n costs in the header fit in size bytes
+static bool valid_binary_header(BinaryHeader *header, size_t size) {
+  size_t offset, costs;
+
+  if (header->version != BINARY_VERSION || header->n == 0 ||
+      header->n_vehicles == 0 ||
+      header->n > SIZE_MAX/sizeof(double)/header->n) {
+    return false;
+  }
+  offset = binary_cost_offset(header->n, header->n_vehicles);
+  costs = (size_t)header->n*header->n*sizeof(double);
+  return offset <= size && costs <= size - offset;
+}
+
+// Maps the file and points the graph's cost matrix straight into it
+static bool read_binary_instance(Instance *inst, int fd, size_t size) {
+  unsigned int i;
+  BinaryHeader header;
+  uint32_t *demands, *capacities;
+  char *mapping;
+
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      !valid_binary_header(&header, size)) {
+    return false;
+  }
+  mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) return false;
+  demands = (uint32_t *)(mapping + sizeof(BinaryHeader));
+  capacities = demands + header.n;
+
+  init_instance_vertices(inst, header.n);
+  for (i = 0; i < header.n; i++) {
+    init_vertice(inst->vertices[i], i, demands[i]);
+  }
+  free(inst->g->cost);
+  inst->g->cost = (double *)(mapping +
+                             binary_cost_offset(header.n, header.n_vehicles));
+  inst->g->mapping = mapping;
+  inst->g->mapping_size = size;
+  build_instance_edges(inst);
+
+  inst->vehicles = malloc(sizeof(Fleet));
+  init_fleet(inst->vehicles, capacities, header.n_vehicles);
+
+  return true;
+}
+
+bool read_instance(Instance *inst, const char *filename) {
+  bool ok;
+  int fd, c;
+  struct stat st;
+  char magic[4];
+  FILE *file;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(BinaryHeader) &&
+      read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+      !memcmp(magic, BINARY_MAGIC, sizeof(magic))) {
+    ok = read_binary_instance(inst, fd, st.st_size);
+    close(fd);
+    return ok;
+  }
+  close(fd);
+
+  // Converted instances start with the vertex count, CVRPLIB files with a
+  // keyword
+  file = fopen(filename, "r");
+  if (!file) return false;
+  c = fgetc(file);
+  ungetc(c, file);
+  if (isdigit(c)) {
+    ok = read_text_instance(inst, file);
+  }
+  else {
+    ok = read_coordinate_instance(inst, file);
+  }
+  fclose(file);
+  return ok;
+}
+
+bool write_binary_instance(Instance *inst, const char *filename) {
+  unsigned int i, j, n_vehicles = inst->vehicles->n_vehicles;
+  size_t offset;
+  BinaryHeader header;
+  uint32_t value;
+  double cost;
+  FILE *file;
+
+  file = fopen(filename, "wb");
+  if (!file) return false;
+
+  memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+  header.version = BINARY_VERSION;
+  header.n = inst->n;
+  header.n_vehicles = n_vehicles;
+  fwrite(&header, sizeof(BinaryHeader), 1, file);
+
+  for (i = 0; i < inst->n; i++) {
+    value = inst->vertices[i]->demand;
+    fwrite(&value, sizeof(uint32_t), 1, file);
+  }
+  for (i = 0; i < inst->vehicles->n_classes; i++) {
+    value = inst->vehicles->capacity[i];
+    for (j = 0; j < inst->vehicles->count[i]; j++) {
+      fwrite(&value, sizeof(uint32_t), 1, file);
+    }
+  }
+  offset = sizeof(BinaryHeader) + (inst->n + n_vehicles)*sizeof(uint32_t);
+  for (; offset < binary_cost_offset(inst->n, n_vehicles); offset++) {
+    fputc(0, file);
+  }
+  for (i = 0; i < inst->n; i++) {
+    for (j = 0; j < inst->n; j++) {
+      cost = graph_cost(inst->g, i, j);
+      fwrite(&cost, sizeof(double), 1, file);
+    }
+  }
+
+  return fclose(file) == 0;
+}
+
+void destroy_instance(Instance *inst) {
+  if (inst) {
+    destroy_fleet(inst->vehicles);
+    free(inst->vertices);
+    free(inst->vertex_block);
+    destroy_graph(inst->g);
+    free(inst);
+    inst = NULL;
+  }
+}
@@ -1,7 +1,25 @@
 #ifndef DATA_H
 #define DATA_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+unsigned int bitset_words(unsigned int n_bits);
+uint64_t *new_bitset(unsigned int n_bits);
+
+static inline bool bitset_test(uint64_t *b, unsigned int i) {
+  return (b[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void bitset_set(uint64_t *b, unsigned int i) {
+  b[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+static inline void bitset_clear(uint64_t *b, unsigned int i) {
+  b[i >> 6] &= ~((uint64_t)1 << (i & 63));
+}
 
 typedef struct Vertice {
   unsigned int id;
@@ -42,6 +60,18 @@ bool remove_value(IntLinkedList *ll, unsigned int val);
 void remove_head(IntLinkedList *ll);
 IntLinkedList *deep_copy(IntLinkedList *ll);
 
+typedef struct Fleet {
+  unsigned int n_classes;
+  unsigned int n_vehicles;
+  unsigned int *capacity;
+  unsigned int *count;
+} Fleet;
+
+void init_fleet(Fleet *f, unsigned int *capacities, unsigned int n);
+void destroy_fleet(Fleet *f);
+int fleet_best_fit(Fleet *f, unsigned int *counts, unsigned int demand);
+unsigned int fleet_largest(Fleet *f, unsigned int *counts);
+
 typedef struct QElement {
   Vertice *value;
   struct QElement *next;
@@ -66,21 +96,53 @@ typedef struct Graph {
   unsigned int n;
   unsigned int *n_edges;
   Vertice **v;
+  // Out edges sorted by cost, with sorted below, built by sort_graph_edges
   Edge ***edges;
+  // Row-major, or with packed the strict lower triangle row by row, for
+  // symmetric costs read through graph_cost
+  double *cost;
+  bool symmetric;
+  bool packed;
+  unsigned int *sorted;
+  atomic_bool rows_sorted;
+  // An edge for every ordered pair, row by row without the diagonal, each
+  // filled in the first time graph_edge hands it out
+  Edge *edge_block;
+  _Atomic uint64_t *edge_ready;
+  void *mapping;
+  size_t mapping_size;
+  double *x;
+  double *y;
+  unsigned int n_neighbours;
+  unsigned int *neighbours;
 } Graph;
 
+static inline double graph_cost(Graph *g, unsigned int i, unsigned int j) {
+  unsigned int k;
+  if (!g->packed) return g->cost[(size_t)i*g->n + j];
+  if (i == j) return 0;
+  if (i < j) {
+    k = i;
+    i = j;
+    j = k;
+  }
+  return g->cost[(size_t)i*(i-1)/2 + j];
+}
+
 void init_graph(Graph *g, unsigned int n_vertices, Vertice **v);
 void init_graph_edges(Graph *g, unsigned int vertice, unsigned int n_edges);
 void quicksort_edges(Graph *g);
+void index_graph_edges(Graph *g);
+Edge *graph_edge(Graph *g, unsigned int i, unsigned int j);
+void sort_graph_edges(Graph *g);
+unsigned int edge_id(Graph *g, Edge *e);
 void destroy_graph(Graph *g);
 unsigned int degree_out(Graph *g, unsigned int vertice);
 Edge **edges_out(Graph *g, unsigned int vertice);
-void bfs(Graph *g, Edge **e_ignore, unsigned int size, Edge *e,
-         Vertice *origin, bool **mark);
-void path(Graph *g, Edge **e_ignore, Vertice **v_ignore, unsigned int size,
-          Edge *e, Vertice *origin, Vertice *dest, bool **mark);
-bool strongly_connected(Graph *g, Edge **e_ignore, Vertice **v_ignore,
-                        unsigned int level, Edge *e, Vertice *origin);
+void fill_euclidean_costs(Graph *g);
+bool costs_symmetric(Graph *g);
+void pack_symmetric_costs(Graph *g);
+void build_neighbour_lists(Graph *g, unsigned int k);
 
 typedef struct Solution {
   double cost;
@@ -92,7 +154,10 @@ void init_solution(Solution *s, unsigned int n_edges);
 void destroy_solution(Solution *s);
 void print_solution(Solution *s);
 bool build_solution_from_sequence(Solution *s, Vertice **sequence, Graph *g,
-                                  IntLinkedList *c, Vertice *origin);
+                                  Fleet *c, Vertice *origin);
+Solution *copy_solution(Solution *s);
+void build_sequence_from_solution(Solution *s, Vertice **sequence,
+                                  Vertice *origin);
 
 typedef struct Tree {
   Vertice *current_v;
@@ -106,19 +171,46 @@ typedef struct Tree {
   unsigned int n_vertices_traversed;
   double cost_so_far;
   unsigned int path_demand_so_far;
-  IntLinkedList *available_vehicles;
-  bool removed_vehicle;
+  unsigned int *vehicles;
+  unsigned int largest_vehicle;
   double lower_bound;
   double upper_bound;
+  double *out_cost;
+  unsigned int *min_cursor;
+  unsigned int *max_cursor;
+  // Costs of the edges the cursors point at, 0 once they run out
+  double *min_cost;
+  double *max_cost;
+  double *duals;
+  unsigned int *assign;
+  uint64_t *excluded;
+  uint64_t *included;
+  uint64_t *visited;
+  unsigned int *vehicle_counts;
+  struct TreePool *pool;
+  // The first customer of the route being built, or of the last one closed
+  Vertice *route_first;
+  // Zobrist hashes of the visited customers and excluded depot edges, and
+  // of the excluded edges of the current vertex
+  uint64_t state_hash;
+  uint64_t head_hash;
+  bool residual_known;
+  bool residual_ok;
+  Edge **prefix;
+  unsigned int n_prefix;
 } Tree;
 
 void init_tree(Tree *t, Vertice *v, Edge *e, bool e_v, Tree *p,
-               IntLinkedList *ll, Vertice *origin, Graph *g);
+               Fleet *fleet, Vertice *origin, Graph *g);
 void init_tree_from_parent(Tree *t, Tree *other, Vertice *v, Edge *e,
                           bool e_v, Vertice *origin, Graph *g);
 void destroy_tree(Tree *t);
 double get_lower_bound(Tree *t, Graph *g, Vertice *origin);
 double get_upper_bound(Tree *t, Graph *g, Vertice *origin);
+void get_bounds(Tree *t, Graph *g, double *lower, double *upper);
+double cursor_cost(Graph *g, unsigned int i, unsigned int cursor);
+void init_bound_state(Tree *t, Graph *g);
+void update_bound_state(Tree *t, Tree *other, Graph *g, Vertice *origin);
 void add_child_to_parent(Tree *parent, Tree *child);
 void build_discarded_edges(Tree *t, Edge **discard_e);
 void build_traversed_vertices_edges(Tree *t, Vertice *origin,
@@ -127,5 +219,72 @@ void build_traversed_edges_in_out(Tree *t, Vertice *origin, Edge **e_ignore,
                                   double *out);
 void build_solution(Tree *t, Solution *s);
 void next_leaf(Tree **current);
+void release_leaf(Tree *t);
+void init_tree_sets(Tree *t, Graph *g);
+void update_tree_sets(Tree *t, Tree *other, Graph *g, Vertice *origin);
+bool edge_ignored(Tree *t, unsigned int id);
+
+typedef struct TreePool {
+  unsigned int n;
+  unsigned int n_classes;
+  size_t stride;
+  unsigned int capacity;
+  unsigned int allocated;
+  unsigned int in_use;
+  unsigned int n_chunks;
+  char **chunks;
+  Tree *free_list;
+} TreePool;
+
+void init_tree_pool(TreePool *p, Graph *g, Fleet *fleet,
+                    unsigned int capacity);
+void destroy_tree_pool(TreePool *p);
+Tree *pool_get_tree(TreePool *p);
+void pool_release_tree(TreePool *p, Tree *t);
+Tree *detach_tree(Tree *t);
+Tree *adopt_tree(TreePool *p, Tree *detached);
+
+typedef struct Workspace {
+  TreePool *pool;
+  bool *mark;
+  bool *smark;
+  Vertice **paths;
+  Vertice **queue;
+  Vertice mock;
+  uint64_t *allowed;
+  uint64_t *reached;
+  unsigned int *ids;
+  double *slack;
+  unsigned int *link;
+  unsigned int *owner;
+  unsigned int *members;
+  bool *done;
+} Workspace;
+
+void init_workspace(Workspace *w, Graph *g, Fleet *fleet);
+void destroy_workspace(Workspace *w);
+void fit_workspace(Workspace *w, Graph *g, Fleet *fleet);
+
+void bfs(Graph *g, Tree *t, Edge *e, Vertice *origin, bool *mark,
+         Workspace *w);
+void path(Graph *g, Tree *t, Edge *e, Vertice *origin, Vertice *dest,
+          bool *mark, Workspace *w);
+bool strongly_connected(Graph *g, Tree *t, Edge *e, Vertice *origin,
+                        Workspace *w);
+bool residual_connected(Graph *g, Tree *t, Edge *e, Vertice *origin,
+                        Workspace *w);
+
+typedef struct Instance {
+  unsigned int n;
+  unsigned int n_edges;
+  Vertice **vertices;
+  Vertice *vertex_block;
+  Graph *g;
+  Fleet *vehicles;
+} Instance;
+
+bool read_instance(Instance *inst, const char *filename);
+bool write_binary_instance(Instance *inst, const char *filename);
+void destroy_instance(Instance *inst);
 
 #endif
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "heuristic.h"
+#include "local_search.h"
+#include "portfolio.h"
+#include "report.h"
+
+// Restarted branch and bound followed by local search. With a time limit
+// and a warm start, the restarts are skipped and the whole budget goes to
+// iterated local search, on a portfolio of workers when there are threads.
+Solution *heuristic_vrp_solve(Graph *g, Fleet *c, Vertice *origin,
+                              int n_iter, double time_limit,
+                              SearchOptions *o) {
+  Solution *best_solution;
+  LocalSearch *ls;
+
+  if (time_limit > 0 && o->warm_start) {
+    best_solution = copy_solution(o->warm_start);
+  }
+  else {
+    best_solution = restart_branch_bound_vrp_solve(g, c, origin, n_iter, 10,
+                                                   o);
+  }
+  if (!best_solution) return NULL;
+
+  log_message(LOG_INFO, "\nEnd branch and bound, begin local search\n\n");
+
+  if (time_limit > 0 && o->n_threads > 1) {
+    return portfolio_local_search(g, c, origin, best_solution, o->n_threads,
+                                  time_limit);
+  }
+  ls = malloc(sizeof(LocalSearch));
+  init_local_search(ls, g, c, origin, best_solution);
+  if (time_limit > 0) {
+    best_solution = iterated_local_search(ls, best_solution, time_limit);
+  }
+  else {
+    best_solution = local_search_descent(ls, best_solution);
+  }
+  destroy_local_search(ls);
+
+  return best_solution;
+}
@@ -0,0 +1,11 @@
+#ifndef HEURISTIC_H
+#define HEURISTIC_H
+
+#include "branch_bound.h"
+#include "data_structures.h"
+
+Solution *heuristic_vrp_solve(Graph *g, Fleet *c, Vertice *origin,
+                              int n_iter, double time_limit,
+                              SearchOptions *o);
+
+#endif
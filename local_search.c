@@ -0,0 +1,535 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "local_search.h"
+#include "report.h"
+
+// Moves must gain more than rounding noise, or equal-cost moves could cycle
+#define MIN_GAIN 1e-9
+// Longest segment moved by Or-opt or exchanged by CROSS
+#define MAX_SEGMENT 3
+// Most random moves in one kick of the iterated local search
+#define MAX_KICKS 4
+// Annealing starts out accepting a loss of this fraction of the cost with
+// probability 1/e
+#define START_TEMPERATURE 0.001
+
+static double link_cost(LocalSearch *ls, Vertice *a, Vertice *b) {
+  return a == b ? 0 : graph_cost(ls->g, a->id, b->id);
+}
+
+// ===========================================================================
+//                                ROUTE STATE
+// ===========================================================================
+
+// Recomputes, after a move, the route of every position (a depot belongs to
+// the route it opens), the load and size of every route and the prefix sums
+static void index_routes(LocalSearch *ls) {
+  unsigned int p, r = 0;
+  Vertice **s = ls->sequence;
+
+  ls->route_of[0] = 0;
+  ls->load[0] = ls->size[0] = 0;
+  ls->forward[0] = ls->backward[0] = 0;
+  ls->demand[0] = 0;
+  ls->n_used = 0;
+  for (p = 1; p < ls->length; p++) {
+    ls->forward[p] = ls->forward[p-1] + link_cost(ls, s[p-1], s[p]);
+    ls->backward[p] = ls->backward[p-1] + link_cost(ls, s[p], s[p-1]);
+    ls->demand[p] = ls->demand[p-1] + s[p]->demand;
+    if (s[p] == ls->origin) {
+      if (ls->size[r]) ls->n_used++;
+      r++;
+      ls->load[r] = ls->size[r] = 0;
+    }
+    else {
+      ls->load[r] += s[p]->demand;
+      ls->size[r]++;
+      ls->position[s[p]->id] = p;
+    }
+    ls->route_of[p] = r;
+  }
+  ls->n_routes = r;
+  ls->cost = ls->forward[ls->length-1];
+}
+
+void init_local_search(LocalSearch *ls, Graph *g, Fleet *fleet,
+                       Vertice *origin, Solution *s) {
+  unsigned int n_edges = s->n_edges;
+
+  ls->g = g;
+  ls->fleet = fleet;
+  ls->origin = origin;
+  ls->length = n_edges + 1;
+  ls->sequence = calloc(ls->length, sizeof(Vertice *));
+  ls->scratch = calloc(ls->length, sizeof(Vertice *));
+  ls->position = calloc(g->n, sizeof(unsigned int));
+  ls->route_of = calloc(ls->length, sizeof(unsigned int));
+  ls->load = calloc(ls->length, sizeof(unsigned int));
+  ls->size = calloc(ls->length, sizeof(unsigned int));
+  ls->counts = calloc(fleet->n_classes, sizeof(unsigned int));
+  ls->forward = calloc(ls->length, sizeof(double));
+  ls->backward = calloc(ls->length, sizeof(double));
+  ls->demand = calloc(ls->length, sizeof(unsigned int));
+  ls->saved = calloc(ls->length, sizeof(Vertice *));
+  ls->best = calloc(ls->length, sizeof(Vertice *));
+  ls->active = malloc(g->n*sizeof(bool));
+  memset(ls->active, true, g->n*sizeof(bool));
+  ls->seed = 1;
+  ls->moves = MOVE_ALL;
+  ls->max_kicks = MAX_KICKS;
+  ls->temperature = START_TEMPERATURE;
+
+  build_sequence_from_solution(s, ls->sequence, origin);
+  index_routes(ls);
+}
+
+void destroy_local_search(LocalSearch *ls) {
+  if (ls) {
+    free(ls->sequence);
+    free(ls->scratch);
+    free(ls->position);
+    free(ls->route_of);
+    free(ls->load);
+    free(ls->size);
+    free(ls->counts);
+    free(ls->forward);
+    free(ls->backward);
+    free(ls->demand);
+    free(ls->saved);
+    free(ls->best);
+    free(ls->active);
+    free(ls);
+    ls = NULL;
+  }
+}
+
+// ===========================================================================
+//                                 FEASIBILITY
+// ===========================================================================
+
+// Whether the fleet still covers the routes once routes ra and rb take the
+// given loads and sizes. Vehicles go to the non-empty routes in order, best
+// fit first, as build_solution_from_sequence hands them out.
+static bool routes_fit(LocalSearch *ls, unsigned int ra, unsigned int load_a,
+                       unsigned int size_a, unsigned int rb,
+                       unsigned int load_b, unsigned int size_b) {
+  unsigned int r, load, size, used;
+  int k;
+  Fleet *f = ls->fleet;
+
+  // With one vehicle class only the two changed routes can overflow
+  if (f->n_classes == 1) {
+    used = ls->n_used - (ls->size[ra] > 0) - (ls->size[rb] > 0) +
+           (size_a > 0) + (size_b > 0);
+    return load_a <= f->capacity[0] && load_b <= f->capacity[0] &&
+           used <= f->count[0];
+  }
+
+  memcpy(ls->counts, f->count, f->n_classes*sizeof(unsigned int));
+  for (r = 0; r < ls->n_routes; r++) {
+    load = r == ra ? load_a : r == rb ? load_b : ls->load[r];
+    size = r == ra ? size_a : r == rb ? size_b : ls->size[r];
+    if (!size) continue;
+    k = fleet_best_fit(f, ls->counts, load);
+    if (k < 0) return false;
+    ls->counts[k]--;
+  }
+  return true;
+}
+
+// Whether a segment of n customers and the given demand can leave route
+// from for route to
+static bool transfer_fits(LocalSearch *ls, unsigned int from, unsigned int to,
+                          unsigned int n, unsigned int demand) {
+  if (from == to) return true;
+  return routes_fit(ls, from, ls->load[from] - demand, ls->size[from] - n,
+                    to, ls->load[to] + demand, ls->size[to] + n);
+}
+
+// Whether positions first to last hold customers of a single route
+static bool is_segment(LocalSearch *ls, int first, int last) {
+  if (first < 1 || last > (int)ls->length - 2) return false;
+  return ls->sequence[last] != ls->origin &&
+         ls->sequence[first] != ls->origin &&
+         ls->route_of[first] == ls->route_of[last];
+}
+
+static unsigned int segment_demand(LocalSearch *ls, unsigned int first,
+                                   unsigned int last) {
+  return ls->demand[last] - ls->demand[first-1];
+}
+
+// ===========================================================================
+//                                   MOVES
+// ===========================================================================
+
+// Cost of the edges inside positions first to last, walked either way
+static double inner_cost(LocalSearch *ls, unsigned int first,
+                         unsigned int last, bool reversed) {
+  if (reversed) return ls->backward[last] - ls->backward[first];
+  return ls->forward[last] - ls->forward[first];
+}
+
+// Rewrites the sequence with the ranges [x1, x1+n1) and [x2, x2+n2) swapped.
+// Either range may be empty, and x1 + n1 <= x2.
+static void exchange_ranges(LocalSearch *ls, unsigned int x1, unsigned int n1,
+                            unsigned int x2, unsigned int n2) {
+  Vertice **s = ls->sequence, **out = ls->scratch;
+  unsigned int gap = x2 - (x1 + n1);
+
+  memcpy(out, s + x2, n2*sizeof(Vertice *));
+  memcpy(out + n2, s + x1 + n1, gap*sizeof(Vertice *));
+  memcpy(out + n2 + gap, s + x1, n1*sizeof(Vertice *));
+  memcpy(s + x1, out, (n1 + gap + n2)*sizeof(Vertice *));
+}
+
+static void reverse_range(LocalSearch *ls, unsigned int first,
+                          unsigned int last) {
+  Vertice *aux, **s = ls->sequence;
+  while (first < last) {
+    aux = s[first];
+    s[first++] = s[last];
+    s[last--] = aux;
+  }
+}
+
+// Each move is applied when it is feasible and changes the cost by less than
+// limit: -MIN_GAIN in a descent, more to accept worse moves
+
+// Or-opt and relocate: moves positions first to last, possibly reversed,
+// between anchor and the position after it
+static bool try_segment_move(LocalSearch *ls, int first, int last, int anchor,
+                             bool reversed, double limit) {
+  Vertice **s = ls->sequence;
+  unsigned int n = last - first + 1;
+  double delta;
+
+  if (!is_segment(ls, first, last)) return false;
+  if (anchor < 0 || anchor > (int)ls->length - 2) return false;
+  if (anchor >= first - 1 && anchor <= last) return false;
+
+  delta = link_cost(ls, s[first-1], s[last+1]) -
+          link_cost(ls, s[first-1], s[first]) -
+          link_cost(ls, s[last], s[last+1]) -
+          link_cost(ls, s[anchor], s[anchor+1]);
+  if (reversed) {
+    delta += link_cost(ls, s[anchor], s[last]) +
+             link_cost(ls, s[first], s[anchor+1]) +
+             inner_cost(ls, first, last, true) -
+             inner_cost(ls, first, last, false);
+  }
+  else {
+    delta += link_cost(ls, s[anchor], s[first]) +
+             link_cost(ls, s[last], s[anchor+1]);
+  }
+  if (delta >= limit) return false;
+  if (!transfer_fits(ls, ls->route_of[first], ls->route_of[anchor], n,
+                     segment_demand(ls, first, last))) {
+    return false;
+  }
+
+  if (anchor > last) {
+    exchange_ranges(ls, first, n, anchor+1, 0);
+    if (reversed) reverse_range(ls, anchor+1 - n, anchor);
+  }
+  else {
+    exchange_ranges(ls, anchor+1, 0, first, n);
+    if (reversed) reverse_range(ls, anchor+1, anchor + n);
+  }
+  return true;
+}
+
+// 2-opt: reverses positions first to last within a route
+static bool try_reversal(LocalSearch *ls, unsigned int first,
+                         unsigned int last, double limit) {
+  Vertice **s = ls->sequence;
+  double delta;
+
+  if (first >= last) return false;
+  delta = link_cost(ls, s[first-1], s[last]) +
+          link_cost(ls, s[first], s[last+1]) -
+          link_cost(ls, s[first-1], s[first]) -
+          link_cost(ls, s[last], s[last+1]) +
+          inner_cost(ls, first, last, true) -
+          inner_cost(ls, first, last, false);
+  if (delta >= limit) return false;
+
+  reverse_range(ls, first, last);
+  return true;
+}
+
+// CROSS exchange between two routes: the n_a customers after position p
+// trade places with the n_b customers from position q, so the vertex at p
+// comes to precede the one at q. One customer each way is a plain exchange.
+static bool try_cross(LocalSearch *ls, unsigned int p, unsigned int n_a,
+                      unsigned int q, unsigned int n_b, double limit) {
+  Vertice **s = ls->sequence;
+  unsigned int a_end = p + n_a, b_end = q + n_b - 1, ra, rb;
+  unsigned int demand_a = 0, demand_b;
+  double delta;
+
+  if (n_a && !is_segment(ls, p+1, a_end)) return false;
+  if (!is_segment(ls, q, b_end)) return false;
+
+  delta = link_cost(ls, s[p], s[q]) +
+          link_cost(ls, s[b_end], s[a_end+1]) -
+          link_cost(ls, s[p], s[p+1]) -
+          link_cost(ls, s[q-1], s[q]) -
+          link_cost(ls, s[b_end], s[b_end+1]);
+  if (n_a) {
+    delta += link_cost(ls, s[q-1], s[p+1]) +
+             link_cost(ls, s[a_end], s[b_end+1]) -
+             link_cost(ls, s[a_end], s[a_end+1]);
+  }
+  else {
+    delta += link_cost(ls, s[q-1], s[b_end+1]);
+  }
+  if (delta >= limit) return false;
+
+  ra = ls->route_of[p];
+  rb = ls->route_of[q];
+  if (n_a) demand_a = segment_demand(ls, p+1, a_end);
+  demand_b = segment_demand(ls, q, b_end);
+  if (!routes_fit(ls, ra, ls->load[ra] - demand_a + demand_b,
+                  ls->size[ra] - n_a + n_b, rb,
+                  ls->load[rb] - demand_b + demand_a,
+                  ls->size[rb] - n_b + n_a)) {
+    return false;
+  }
+
+  if (p < q) exchange_ranges(ls, p+1, n_a, q, n_b);
+  else exchange_ranges(ls, q, n_b, p+1, n_a);
+  return true;
+}
+
+// Tries the moves in ls->moves that bring the customers at p and q next to
+// each other, applying the first one that improves the solution
+static bool improve_pair(LocalSearch *ls, int p, int q) {
+  int len, a, b;
+
+  if (ls->moves & MOVE_SEGMENT) {
+    for (len = 1; len <= MAX_SEGMENT; len++) {
+      if (try_segment_move(ls, p, p + len-1, q, false, -MIN_GAIN) ||
+          try_segment_move(ls, p - len+1, p, q-1, false, -MIN_GAIN)) {
+        return true;
+      }
+      if (len == 1) continue;
+      if (try_segment_move(ls, p, p + len-1, q-1, true, -MIN_GAIN) ||
+          try_segment_move(ls, p - len+1, p, q, true, -MIN_GAIN)) {
+        return true;
+      }
+    }
+  }
+
+  if (ls->route_of[p] == ls->route_of[q]) {
+    if (!(ls->moves & MOVE_REVERSAL)) return false;
+    a = p < q ? p : q;
+    b = p < q ? q : p;
+    return try_reversal(ls, a+1, b, -MIN_GAIN) ||
+           try_reversal(ls, a, b-1, -MIN_GAIN);
+  }
+
+  if (!(ls->moves & MOVE_CROSS)) return false;
+  for (b = 1; b <= MAX_SEGMENT; b++) {
+    for (a = 0; a <= MAX_SEGMENT; a++) {
+      if (try_cross(ls, p, a, q, b, -MIN_GAIN)) return true;
+    }
+  }
+  return false;
+}
+
+// ===========================================================================
+//                                  DESCENT
+// ===========================================================================
+
+// Marks the customers within reach of a move at position p as worth
+// another look
+static void wake_around(LocalSearch *ls, int p) {
+  int i;
+  for (i = p - MAX_SEGMENT - 1; i <= p + MAX_SEGMENT + 1; i++) {
+    if (i < 0 || i >= (int)ls->length) continue;
+    ls->active[ls->sequence[i]->id] = true;
+  }
+}
+
+// First-improvement descent over 2-opt, Or-opt, relocate, exchange and CROSS
+// moves. Candidates pair each customer with the vertices on its neighbour
+// list only, and every move is priced from the edges it changes before the
+// sequence is touched. Customers whose surroundings did not change since
+// they last failed to improve are skipped.
+static bool descend(LocalSearch *ls) {
+  bool change = true, improved = false;
+  unsigned int v, i, u, p, q, k = ls->g->n_neighbours;
+  unsigned int *neighbours;
+
+  while (change) {
+    change = false;
+    for (v = 0; v < ls->g->n; v++) {
+      if (v == ls->origin->id || !ls->active[v]) continue;
+      ls->active[v] = false;
+      neighbours = ls->g->neighbours + (size_t)v*k;
+      for (i = 0; i < k; i++) {
+        u = neighbours[i];
+        if (u == ls->origin->id || u == v) continue;
+        p = ls->position[v];
+        q = ls->position[u];
+        if (improve_pair(ls, p, q)) {
+          index_routes(ls);
+          wake_around(ls, p);
+          wake_around(ls, q);
+          wake_around(ls, ls->position[v]);
+          wake_around(ls, ls->position[u]);
+          change = improved = true;
+          break;
+        }
+      }
+    }
+  }
+  return improved;
+}
+
+// Replaces best_solution by the solution in the sequence
+static Solution *materialize(LocalSearch *ls, Solution *best_solution) {
+  Solution *solution = malloc(sizeof(Solution));
+  init_solution(solution, ls->length - 1);
+  build_solution_from_sequence(solution, ls->sequence, ls->g, ls->fleet,
+                               ls->origin);
+  destroy_solution(best_solution);
+  return solution;
+}
+
+Solution *local_search_descent(LocalSearch *ls, Solution *best_solution) {
+  if (!descend(ls)) return best_solution;
+  return materialize(ls, best_solution);
+}
+
+// ===========================================================================
+//                           ITERATED LOCAL SEARCH
+// ===========================================================================
+
+void save_sequence(LocalSearch *ls, Vertice **to) {
+  memcpy(to, ls->sequence, ls->length*sizeof(Vertice *));
+}
+
+// Makes sequence, which must have the same length, the current solution
+void adopt_sequence(LocalSearch *ls, Vertice **sequence) {
+  memcpy(ls->sequence, sequence, ls->length*sizeof(Vertice *));
+  index_routes(ls);
+  memset(ls->active, true, ls->g->n*sizeof(bool));
+  descend(ls);
+  ls->current_cost = ls->cost;
+  save_sequence(ls, ls->saved);
+  if (ls->cost < ls->best_cost - MIN_GAIN) {
+    ls->best_cost = ls->cost;
+    save_sequence(ls, ls->best);
+  }
+}
+
+static void restore_sequence(LocalSearch *ls, Vertice **from) {
+  memcpy(ls->sequence, from, ls->length*sizeof(Vertice *));
+  index_routes(ls);
+}
+
+// Kicks the solution with a random feasible relocation or CROSS exchange
+// towards a neighbour, whatever it costs
+static void random_move(LocalSearch *ls) {
+  unsigned int v, u, k = ls->g->n_neighbours, len, p, q;
+
+  if (!k) return;
+  do {
+    v = rand_r(&ls->seed) % ls->g->n;
+  } while (v == ls->origin->id);
+  u = ls->g->neighbours[(size_t)v*k + rand_r(&ls->seed) % k];
+  if (u == ls->origin->id || u == v) return;
+
+  p = ls->position[v];
+  q = ls->position[u];
+  len = 1 + rand_r(&ls->seed) % MAX_SEGMENT;
+  if (ls->route_of[p] != ls->route_of[q] && rand_r(&ls->seed) % 2) {
+    if (!try_cross(ls, p, rand_r(&ls->seed) % (MAX_SEGMENT+1), q, len,
+                   INFINITY)) {
+      return;
+    }
+  }
+  else if (!try_segment_move(ls, p, p + len-1, q, false, INFINITY)) {
+    return;
+  }
+  index_routes(ls);
+  wake_around(ls, p);
+  wake_around(ls, q);
+}
+
+// One round of iterated local search: kicks the current solution with a few
+// random moves and descends again. The result replaces the current solution
+// when it is better, or worse by less than simulated annealing allows at
+// the given temperature. Rounds work on the preallocated sequences only.
+void iterate_local_search(LocalSearch *ls, double temperature) {
+  unsigned int i, n_kicks = 1 + rand_r(&ls->seed) % ls->max_kicks;
+
+  for (i = 0; i < n_kicks; i++) {
+    random_move(ls);
+  }
+  descend(ls);
+
+  if (ls->cost < ls->current_cost - MIN_GAIN ||
+      (temperature > 0 && (rand_r(&ls->seed) + 1.0)/(RAND_MAX + 2.0) <
+       exp((ls->current_cost - ls->cost)/temperature))) {
+    ls->current_cost = ls->cost;
+    save_sequence(ls, ls->saved);
+    if (ls->cost < ls->best_cost - MIN_GAIN) {
+      ls->best_cost = ls->cost;
+      save_sequence(ls, ls->best);
+    }
+  }
+  else {
+    restore_sequence(ls, ls->saved);
+  }
+}
+
+// Temperature after elapsed of time_limit seconds, cooling linearly from
+// ls->temperature times the starting cost
+double annealing_temperature(LocalSearch *ls, double elapsed,
+                             double time_limit) {
+  return ls->temperature*ls->start_cost*(1 - elapsed/time_limit);
+}
+
+void begin_iterated_search(LocalSearch *ls) {
+  descend(ls);
+  ls->start_cost = ls->current_cost = ls->best_cost = ls->cost;
+  save_sequence(ls, ls->saved);
+  save_sequence(ls, ls->best);
+}
+
+// Builds the best solution seen, if it beats best_solution
+Solution *finish_iterated_search(LocalSearch *ls, Solution *best_solution) {
+  restore_sequence(ls, ls->best);
+  if (ls->cost >= best_solution->cost - MIN_GAIN) return best_solution;
+  return materialize(ls, best_solution);
+}
+
+// Iterated local search until time_limit seconds have passed, a Solution
+// being built once at the end
+Solution *iterated_local_search(LocalSearch *ls, Solution *best_solution,
+                                double time_limit) {
+  unsigned long rounds = 0;
+  double elapsed;
+  struct timespec start;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  begin_iterated_search(ls);
+  while ((elapsed = seconds_since(&start)) < time_limit) {
+    iterate_local_search(ls, annealing_temperature(ls, elapsed, time_limit));
+    rounds++;
+  }
+
+  log_message(LOG_INFO, "Local search rounds: %lu in %.3f s\n\n", rounds,
+              seconds_since(&start));
+
+  return finish_iterated_search(ls, best_solution);
+}
@@ -0,0 +1,63 @@
+#ifndef LOCAL_SEARCH_H
+#define LOCAL_SEARCH_H
+
+#include "data_structures.h"
+
+// Neighbourhoods a local search draws its moves from
+typedef enum MoveKind {
+  MOVE_SEGMENT = 1,   // relocate and Or-opt
+  MOVE_REVERSAL = 2,  // 2-opt
+  MOVE_CROSS = 4,     // exchange and CROSS
+  MOVE_ALL = 7
+} MoveKind;
+
+// A solution as its vertex sequence, depot at both ends and between routes.
+// Alongside it are the route, load and size of every position and route,
+// and prefix sums of cost both ways and of demand along the sequence, so
+// that moves are priced and checked without rebuilding the solution.
+typedef struct LocalSearch {
+  Graph *g;
+  Fleet *fleet;
+  Vertice *origin;
+  Vertice **sequence;
+  Vertice **scratch;
+  unsigned int length;
+  unsigned int *position;
+  unsigned int *route_of;
+  unsigned int *load;
+  unsigned int *size;
+  unsigned int n_routes;
+  unsigned int n_used;
+  unsigned int *counts;
+  double *forward;
+  double *backward;
+  unsigned int *demand;
+  double cost;
+  bool *active;
+  // Iterated local search state and its parameters
+  Vertice **saved;
+  Vertice **best;
+  double start_cost;
+  double current_cost;
+  double best_cost;
+  unsigned int seed;
+  unsigned int moves;
+  unsigned int max_kicks;
+  double temperature;
+} LocalSearch;
+
+void init_local_search(LocalSearch *ls, Graph *g, Fleet *fleet,
+                       Vertice *origin, Solution *s);
+void destroy_local_search(LocalSearch *ls);
+Solution *local_search_descent(LocalSearch *ls, Solution *best_solution);
+void begin_iterated_search(LocalSearch *ls);
+void iterate_local_search(LocalSearch *ls, double temperature);
+double annealing_temperature(LocalSearch *ls, double elapsed,
+                             double time_limit);
+Solution *finish_iterated_search(LocalSearch *ls, Solution *best_solution);
+void save_sequence(LocalSearch *ls, Vertice **to);
+void adopt_sequence(LocalSearch *ls, Vertice **sequence);
+Solution *iterated_local_search(LocalSearch *ls, Solution *best_solution,
+                                double time_limit);
+
+#endif
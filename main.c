@@ -3,288 +3,287 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "branch_bound.h"
+#include "construction.h"
 #include "data_structures.h"
+#include "heuristic.h"
+#include "reoptimize.h"
+#include "report.h"
+#include "service.h"
+
+static FILE *open_trace(const char *path) {
+  FILE *trace = fopen(path, "w");
+  if (trace) begin_search_trace(trace);
+  return trace;
+}
 
-Solution *branch_bound_vrp_solve(Graph *g, IntLinkedList *c, Vertice *origin,
-                                 int n_iter, unsigned int initial) {
-  Solution *best_solution = NULL, *solution;
-  unsigned int degree, level, i, it_counter = 0;
-  Tree *root, *current, *nnode;
-  Vertice *vertice, *v, **v_ignore;
-  Edge *edge, **e_ignore, **out_edges;
-  IntLinkedList *vehicles;
-  double global_upper_bound;
-
-  printf("Begin branch and bound!\n\n");
-
-  root = malloc(sizeof(Tree));
-  init_tree(root, origin, NULL, false, NULL, c, origin, g);
-
-  out_edges = edges_out(g, origin->id);
-  edge = out_edges[initial];
+static void close_trace(FILE *trace) {
+  end_search_trace(trace);
+  fclose(trace);
+}
 
-  nnode = malloc(sizeof(Tree));
-  init_tree_from_parent(nnode, root, edge->dest, edge, true, origin, g);
-  add_child_to_parent(root, nnode);
-  global_upper_bound = nnode->upper_bound;
+// Parses a comma-separated list of ids into ids, returning how many
+static unsigned int parse_id_list(const char *list, unsigned int **ids) {
+  unsigned int n = 1;
+  const char *c;
+  char *end;
 
-  nnode = malloc(sizeof(Tree));
-  init_tree_from_parent(nnode, root, edge->origin, edge, false, origin, g);
-  add_child_to_parent(root, nnode);
-  if (nnode->upper_bound < global_upper_bound) {
-    global_upper_bound = nnode->upper_bound;
+  for (c = list; *c; c++) {
+    if (*c == ',') n++;
   }
-
-  current = root->left_child;
-
-  while (current) {
-    it_counter++;
-    if (n_iter && n_iter > 0 && it_counter > n_iter) {
-      destroy_tree(root);
-      return best_solution;
-    }
-    else if (n_iter && n_iter < 0 && best_solution) {
-      destroy_tree(root);
-      return best_solution;
+  *ids = malloc(n*sizeof(unsigned int));
+  for (n = 0; *list; list = *end ? end + 1 : end) {
+    (*ids)[n++] = strtoul(list, &end, 10);
+    if (end == list) {
+      n--;
+      end++;
     }
+  }
+  return n;
+}
 
-    vertice = current->current_v;
-    level = current->level;
+// Serves jobs with the options given for a single run
+static int serve(ServiceOptions *service, SearchOptions *options,
+                 Constructor construct, double time_limit,
+                 const char *trace_path) {
+  bool ok;
+
+  service->search = *options;
+  service->construct = construct;
+  service->time_limit = time_limit;
+  if (trace_path) {
+    service->search.trace = open_trace(trace_path);
+    if (!service->search.trace) {
+      printf("ERROR: Could not open trace file %s.\n", trace_path);
+      return 1;
+    }
+  }
+  ok = run_service(service);
+  if (service->search.trace) close_trace(service->search.trace);
+  if (!ok) {
+    printf("ERROR: Could not listen on %s.\n", service->socket_path);
+    return 1;
+  }
+  return 0;
+}
 
-    if (vertice == origin) {
-      vehicles = deep_copy(current->available_vehicles);
-      if (!remove_value(vehicles, current->path_demand_so_far)) {
-        destroy_linkedlist(vehicles);
-        next_leaf(&current);
-        continue;
+int main(int argc, char const *argv[]) {
+  char const *args[4];
+  int i, n_args = 0;
+  SearchOptions options;
+  ServiceOptions service;
+  bool serving = false;
+  Constructor construct = construct_solution;
+  double time_limit = 0;
+  char const *trace_path = NULL;
+  bool json = false;
+  char const *previous_path = NULL, *removed = "", *changed = "";
+  unsigned int *previous = NULL, length = 0;
+  InstanceDelta delta;
+  LogLevel log_level = LOG_INFO;
+  SearchStats stats = {0};
+  IncumbentLog incumbents = {0, 0};
+  struct timespec start, end;
+
+  init_search_options(&options);
+  init_service_options(&service);
+  init_instance_delta(&delta);
+  for (i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--threads") && i+1 < argc) {
+      options.n_threads = atoi(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--policy") && i+1 < argc) {
+      if (!parse_node_policy(argv[++i], &options.policy)) {
+        printf("ERROR: Unknown node policy %s.", argv[i]);
+        return 1;
       }
-      current->available_vehicles = vehicles;
-      current->removed_vehicle = true;
-      current->path_demand_so_far = 0;
-      if (current->n_vertices_traversed == g->n) {
-        solution = malloc(sizeof(Solution));
-        build_solution(current, solution);
-
-        if (!best_solution || solution->cost < best_solution->cost) {
-          destroy_solution(best_solution);
-          best_solution = solution;
-          print_solution(solution);
-        }
-        else {
-          destroy_solution(solution);
-        }
-
-        next_leaf(&current);
-        continue;
+      continue;
+    }
+    if (!strcmp(argv[i], "--bound") && i+1 < argc) {
+      options.bound = find_bound_engine(argv[++i]);
+      if (!options.bound) {
+        printf("ERROR: Unknown bound engine %s.", argv[i]);
+        return 1;
       }
+      continue;
     }
-
-    if (current->lower_bound >= global_upper_bound) {
-      next_leaf(&current);
+    if (!strcmp(argv[i], "--symmetry")) {
+      options.break_symmetry = true;
       continue;
     }
-
-    v_ignore = calloc(level, sizeof(Vertice *));
-    e_ignore = calloc(level, sizeof(Edge *));
-    build_traversed_vertices_edges(current, origin, v_ignore, e_ignore);
-    out_edges = edges_out(g, vertice->id);
-    degree = degree_out(g, vertice->id);
-    for (i = 0; i < degree; i++) {
-      edge = out_edges[i];
-      if (in_edges_array(e_ignore, edge, level)) continue;
-      v = edge->dest;
-      if (in_vertices_array(v_ignore, v, level)) continue;
-
-      if (!best_solution ||
-          current->cost_so_far + edge->cost < best_solution->cost) {
-        nnode = malloc(sizeof(Tree));
-        init_tree_from_parent(nnode, current, edge->dest, edge, true, origin, g);
-        if (nnode->path_demand_so_far > nnode->available_vehicles->tail->value) {
-          destroy_tree(nnode);
-        }
-        else if (nnode->lower_bound > global_upper_bound) {
-          destroy_tree(nnode);
-        }
-        else {
-          add_child_to_parent(current, nnode);
-          if (nnode->upper_bound < global_upper_bound) {
-            global_upper_bound = nnode->upper_bound;
-          }
-        }
+    if (!strcmp(argv[i], "--table") && i+1 < argc) {
+      options.table_bytes = (size_t)(atof(argv[++i])*(1 << 20));
+      continue;
+    }
+    if (!strcmp(argv[i], "--construct") && i+1 < argc) {
+      if (!strcmp(argv[++i], "none")) {
+        construct = NULL;
+        continue;
       }
-      if (strongly_connected(g, e_ignore, v_ignore, level, edge, origin)) {
-        nnode = malloc(sizeof(Tree));
-        init_tree_from_parent(nnode, current, edge->origin, edge, false, origin, g);
-        if (nnode->lower_bound >= global_upper_bound) {
-          destroy_tree(nnode);
-        }
-        else {
-          add_child_to_parent(current, nnode);
-          if (nnode->upper_bound < global_upper_bound) {
-            global_upper_bound = nnode->upper_bound;
-          }
-        }
+      construct = find_constructor(argv[i]);
+      if (!construct) {
+        printf("ERROR: Unknown construction heuristic %s.", argv[i]);
+        return 1;
       }
-
-      break;
+      continue;
     }
-    free(e_ignore);
-    free(v_ignore);
-
-    next_leaf(&current);
-  }
-
-  return best_solution;
-}
-
-Solution *heuristic_vrp_solve(Graph *g, IntLinkedList *c, Vertice *origin,
-                              int n_iter) {
-  bool change = true;
-  unsigned int i, j, n_edges;
-  Solution *best_solution, *best_bb_solution, *solution;
-  Vertice *aux, **sequence;
-  
-  for (i = 0; i < 10; i++) {
-    best_bb_solution = branch_bound_vrp_solve(g, c, origin, n_iter, i);
-    if (best_bb_solution) {
-      if (!best_solution || best_bb_solution->cost < best_solution->cost) {
-        best_solution = best_bb_solution;
-      }
+    if (!strcmp(argv[i], "--time-limit") && i+1 < argc) {
+      time_limit = atof(argv[++i]);
+      continue;
     }
-  }
-  if (!best_solution) return NULL;
-  best_solution = best_bb_solution;
-  n_edges = best_bb_solution->n_edges;
-  sequence = calloc(n_edges + 1, sizeof(Vertice *));
-
-  printf("\nEnd branch and bound, begin local search\n\n");
-
-  for (i = 0; i < n_edges; i++) {
-    sequence[i] = best_bb_solution->edges[n_edges-1 - i]->origin;
-  }
-  sequence[n_edges] = best_bb_solution->edges[0]->dest;
-
-  while (change) {
-    change = false;
-    for (i = 1; i < n_edges; i++) {
-      for (j = i+1; j < n_edges; j++) {
-        aux = sequence[i];
-        sequence[i] = sequence[j];
-        sequence[j] = aux;
-        solution = malloc(sizeof(Solution));
-        init_solution(solution, n_edges);
-        if (build_solution_from_sequence(solution, sequence, g, c, origin)) {
-          if (solution->cost < best_solution->cost) {
-            destroy_solution(best_solution);
-            best_solution = solution;
-            print_solution(solution);
-            change = true;
-          }
-          else goto UNDO;
-        }
-        else {
-          UNDO: aux = sequence[i];
-          sequence[i] = sequence[j];
-          sequence[j] = aux;
-          destroy_solution(solution);
-        }
+    if (!strcmp(argv[i], "--max-nodes") && i+1 < argc) {
+      options.max_nodes = atoi(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--progress") && i+1 < argc) {
+      options.progress_interval = atof(argv[++i]);
+      continue;
+    }
+    if (!strcmp(argv[i], "--trace") && i+1 < argc) {
+      trace_path = argv[++i];
+      continue;
+    }
+    if (!strcmp(argv[i], "--log") && i+1 < argc) {
+      if (!parse_log_level(argv[++i], &log_level)) {
+        printf("ERROR: Unknown log level %s.", argv[i]);
+        return 1;
       }
+      continue;
+    }
+    if (!strcmp(argv[i], "--json")) {
+      json = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--previous") && i+1 < argc) {
+      previous_path = argv[++i];
+      continue;
+    }
+    if (!strcmp(argv[i], "--removed") && i+1 < argc) {
+      removed = argv[++i];
+      continue;
+    }
+    if (!strcmp(argv[i], "--changed") && i+1 < argc) {
+      changed = argv[++i];
+      continue;
+    }
+    if (!strcmp(argv[i], "--fleet-changed")) {
+      delta.fleet_changed = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--serve")) {
+      serving = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--socket") && i+1 < argc) {
+      service.socket_path = argv[++i];
+      continue;
+    }
+    if (!strcmp(argv[i], "--workers") && i+1 < argc) {
+      service.n_workers = atoi(argv[++i]);
+      continue;
+    }
+    if (n_args < 4) {
+      args[n_args] = argv[i];
     }
+    n_args++;
   }
 
-  free(sequence);
-
-  return best_solution;
-}
-
-int main(int argc, char const *argv[]) {
-
-  if (argc != 3 && argc != 4) {
+  if (serving) {
+    return serve(&service, &options, construct, time_limit, trace_path);
+  }
+  if (n_args != 3 && n_args != 4) {
     printf("ERROR: Please specify both instance name and algorithm.");
     return 1;
   }
 
-  unsigned int i, j, c;
+  set_log_level(log_level);
+  options.stats = &stats;
+  options.on_incumbent = log_incumbent;
+  options.incumbent_context = &incumbents;
 
-  size_t bufsize = 32;
-  char *buffer = malloc(bufsize*sizeof(char));
-  FILE *file;
-  file = fopen(argv[1], "r");
-  getline(&buffer, &bufsize, file);
-
-  bool algorithm = atoi(argv[2]);
+  bool algorithm = atoi(args[2]);
   int n_iter = 0;
   if (algorithm) {
-    n_iter = atoi(argv[3]);
+    n_iter = atoi(args[3]);
   }
 
-  unsigned int n_v = atoi(buffer);
-  unsigned int n_e = (n_v * n_v) - n_v;
-
-  Vertice **vertices = malloc(n_v*sizeof(Vertice *));
-  for (i = 0; i < n_v; i++) {
-    vertices[i] = malloc(sizeof(Vertice));
-    getline(&buffer, &bufsize, file);
-    init_vertice(vertices[i], i, atoi(buffer));
+  Instance *instance = malloc(sizeof(Instance));
+  if (!read_instance(instance, args[1])) {
+    printf("ERROR: Could not read instance %s.\n", args[1]);
+    free(instance);
+    return 1;
   }
-
-  Graph *g = malloc(sizeof(Graph));
-  init_graph(g, n_v, vertices);
-  for (i = 0; i < n_v; i++) {
-    init_graph_edges(g, i, n_v-1);
+  if (trace_path) {
+    options.trace = open_trace(trace_path);
+    if (!options.trace) {
+      printf("ERROR: Could not open trace file %s.\n", trace_path);
+      destroy_instance(instance);
+      return 1;
+    }
   }
 
-  Edge **edges = malloc(n_e*sizeof(Edge *));
-  c = 0;
-  for (i = 0; i < n_v; i++) {
-    for (j = 0; j < n_v; j++) {
-      if (i == j) continue;
-      edges[c] = malloc(sizeof(Edge));
-      getline(&buffer, &bufsize, file);
-      init_edge(edges[c], vertices[i], vertices[j], atof(buffer));
-      if (j > i) {
-        g->edges[i][j-1] = edges[c];
-      }
-      else {
-        g->edges[i][j] = edges[c];
-      }
-      c++;
+  if (previous_path) {
+    previous = read_previous_routes(previous_path, &length);
+    if (!previous) {
+      printf("ERROR: Could not read routes %s.\n", previous_path);
+      if (options.trace) close_trace(options.trace);
+      destroy_instance(instance);
+      return 1;
     }
+    delta.n_removed = parse_id_list(removed, &delta.removed);
+    delta.n_changed = parse_id_list(changed, &delta.changed);
   }
-  quicksort_edges(g);
 
-  IntLinkedList *vehicles = malloc(sizeof(IntLinkedList));
-  for (i = 0; i < n_v; i++) {
-    getline(&buffer, &bufsize, file);
-    add_value(vehicles, atoi(buffer));
+  Graph *g = instance->g;
+  Vertice **vertices = instance->vertices;
+  Fleet *vehicles = instance->vehicles;
+
+  // A constructed solution bounds the search and starts the local search,
+  // unless the previous routes are repaired instead
+  if (construct && !previous) {
+    options.warm_start = construct(g, vehicles, vertices[0]);
+    log_message(LOG_INFO, "Constructed solution\n\n");
+    log_solution(LOG_INFO, options.warm_start);
   }
 
   Solution *s;
-  if (algorithm) {
-    s = heuristic_vrp_solve(g, vehicles, vertices[0], n_iter);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (previous) {
+    s = reoptimize_routes(g, vehicles, vertices[0], previous, length, &delta,
+                          n_iter, time_limit, !algorithm, &options);
   }
-  else {
-    s = branch_bound_vrp_solve(g, vehicles, vertices[0], n_iter, 0);
+  else if (algorithm) {
+    s = heuristic_vrp_solve(g, vehicles, vertices[0], n_iter, time_limit,
+                            &options);
   }
-
-  print_solution(s);
-
-  destroy_solution(s);
-  destroy_linkedlist(vehicles);
-
-  for (i = 0; i < n_v; i++) {
-    destroy_vertice(vertices[i]);
+  else {
+    s = branch_bound_vrp_solve_with(g, vehicles, vertices[0], n_iter, 0,
+                                    &options);
   }
 
-  for (i = 0; i < n_e; i++) {
-    destroy_edge(edges[i]);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  log_solution(LOG_RESULT, s);
+  if (json) {
+    write_result_json(stdout, args[1],
+                      previous ? "reoptimize" :
+                      algorithm ? "heuristic" : "branch_bound", s,
+                      vertices[0], (end.tv_sec - start.tv_sec) +
+                      (end.tv_nsec - start.tv_nsec)*1e-9, &stats,
+                      &incumbents);
+    printf("\n");
   }
 
-  free(vertices);
-  free(edges);
-
-  destroy_graph(g);
+  if (options.trace) close_trace(options.trace);
+  destroy_solution(s);
+  destroy_solution(options.warm_start);
+  destroy_instance(instance);
+  free(previous);
+  free(delta.removed);
+  free(delta.changed);
 
   return 0;
 }
@@ -0,0 +1,197 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "local_search.h"
+#include "portfolio.h"
+#include "report.h"
+
+// Solutions kept in the elite pool
+#define ELITE_SIZE 8
+// Rounds a worker runs between visits to the elite pool
+#define SYNC_ROUNDS 64
+
+// The elite pool holds the best distinct solutions the workers have found.
+// Workers only lock it every SYNC_ROUNDS rounds, to offer their best and,
+// when their current solution has fallen behind the pool, to take an elite
+// solution to continue from.
+typedef struct ElitePool {
+  pthread_mutex_t lock;
+  unsigned int size, length;
+  Vertice **sequences;
+  double costs[ELITE_SIZE];
+} ElitePool;
+
+// How a worker searches: its neighbourhoods, kick strength and starting
+// temperature, so workers with the same start still diverge
+typedef struct WorkerMix {
+  unsigned int moves;
+  unsigned int max_kicks;
+  double temperature;
+} WorkerMix;
+
+typedef struct PortfolioWorker {
+  pthread_t thread;
+  LocalSearch *ls;
+  ElitePool *pool;
+  double time_limit;
+  unsigned long rounds;
+} PortfolioWorker;
+
+static const WorkerMix worker_mixes[] = {
+  {MOVE_ALL, 4, 0.001},
+  {MOVE_ALL, 8, 0.002},
+  {MOVE_SEGMENT | MOVE_REVERSAL, 3, 0.0005},
+  {MOVE_SEGMENT | MOVE_CROSS, 6, 0.001},
+  {MOVE_ALL, 2, 0.0002},
+  {MOVE_ALL, 12, 0.004}
+};
+
+// ===========================================================================
+//                                 ELITE POOL
+// ===========================================================================
+
+static void init_elite_pool(ElitePool *p, unsigned int length) {
+  pthread_mutex_init(&p->lock, NULL);
+  p->size = 0;
+  p->length = length;
+  p->sequences = calloc(ELITE_SIZE*length, sizeof(Vertice *));
+}
+
+static void destroy_elite_pool(ElitePool *p) {
+  pthread_mutex_destroy(&p->lock);
+  free(p->sequences);
+}
+
+// Offers the best solution of ls, which replaces the worst elite once the
+// pool is full. Equal costs are taken for the same solution.
+static void offer_elite(ElitePool *p, LocalSearch *ls) {
+  unsigned int i, slot;
+
+  for (i = 0; i < p->size; i++) {
+    if (p->costs[i] == ls->best_cost) return;
+  }
+  if (p->size < ELITE_SIZE) {
+    slot = p->size++;
+  }
+  else {
+    slot = 0;
+    for (i = 1; i < p->size; i++) {
+      if (p->costs[i] > p->costs[slot]) slot = i;
+    }
+    if (p->costs[slot] <= ls->best_cost) return;
+  }
+  memcpy(p->sequences + slot*p->length, ls->best,
+         p->length*sizeof(Vertice *));
+  p->costs[slot] = ls->best_cost;
+}
+
+static double worst_elite(ElitePool *p) {
+  unsigned int i;
+  double worst = p->costs[0];
+  for (i = 1; i < p->size; i++) {
+    if (p->costs[i] > worst) worst = p->costs[i];
+  }
+  return worst;
+}
+
+static void visit_elite_pool(ElitePool *p, LocalSearch *ls) {
+  unsigned int slot;
+
+  pthread_mutex_lock(&p->lock);
+  offer_elite(p, ls);
+  if (p->size == ELITE_SIZE && ls->current_cost > worst_elite(p)) {
+    slot = rand_r(&ls->seed) % p->size;
+    memcpy(ls->saved, p->sequences + slot*p->length,
+           p->length*sizeof(Vertice *));
+    pthread_mutex_unlock(&p->lock);
+    adopt_sequence(ls, ls->saved);
+    return;
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+// ===========================================================================
+//                                  PORTFOLIO
+// ===========================================================================
+
+static void *portfolio_run(void *arg) {
+  PortfolioWorker *wk = arg;
+  LocalSearch *ls = wk->ls;
+  double elapsed;
+  struct timespec start;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  begin_iterated_search(ls);
+  while ((elapsed = seconds_since(&start)) < wk->time_limit) {
+    iterate_local_search(ls, annealing_temperature(ls, elapsed,
+                                                   wk->time_limit));
+    if (++wk->rounds % SYNC_ROUNDS == 0) {
+      visit_elite_pool(wk->pool, ls);
+    }
+  }
+  pthread_mutex_lock(&wk->pool->lock);
+  offer_elite(wk->pool, ls);
+  pthread_mutex_unlock(&wk->pool->lock);
+
+  return NULL;
+}
+
+// Runs n_workers iterated local searches from start for time_limit seconds,
+// each with its own seed and mix of neighbourhoods, exchanging solutions
+// through an elite pool. Returns the best solution found, which replaces
+// start if it is cheaper.
+Solution *portfolio_local_search(Graph *g, Fleet *c, Vertice *origin,
+                                 Solution *start, unsigned int n_workers,
+                                 double time_limit) {
+  unsigned int i, n_mixes = sizeof(worker_mixes)/sizeof(WorkerMix);
+  unsigned long rounds = 0;
+  const WorkerMix *mix;
+  PortfolioWorker *workers;
+  ElitePool pool;
+  LocalSearch *best = NULL;
+  struct timespec clock_start;
+
+  if (n_workers < 1) n_workers = 1;
+  clock_gettime(CLOCK_MONOTONIC, &clock_start);
+  workers = calloc(n_workers, sizeof(PortfolioWorker));
+  for (i = 0; i < n_workers; i++) {
+    mix = &worker_mixes[i % n_mixes];
+    workers[i].ls = malloc(sizeof(LocalSearch));
+    init_local_search(workers[i].ls, g, c, origin, start);
+    workers[i].ls->seed = i + 1;
+    workers[i].ls->moves = mix->moves;
+    workers[i].ls->max_kicks = mix->max_kicks;
+    workers[i].ls->temperature = mix->temperature;
+    workers[i].time_limit = time_limit;
+    workers[i].pool = &pool;
+  }
+  init_elite_pool(&pool, workers[0].ls->length);
+
+  for (i = 0; i < n_workers; i++) {
+    pthread_create(&workers[i].thread, NULL, portfolio_run, &workers[i]);
+  }
+  for (i = 0; i < n_workers; i++) {
+    pthread_join(workers[i].thread, NULL);
+    rounds += workers[i].rounds;
+    if (!best || workers[i].ls->best_cost < best->best_cost) {
+      best = workers[i].ls;
+    }
+  }
+
+  log_message(LOG_INFO, "Local search rounds: %lu in %.3f s across %u "
+              "workers\n\n", rounds, seconds_since(&clock_start), n_workers);
+
+  start = finish_iterated_search(best, start);
+  for (i = 0; i < n_workers; i++) {
+    destroy_local_search(workers[i].ls);
+  }
+  destroy_elite_pool(&pool);
+  free(workers);
+
+  return start;
+}
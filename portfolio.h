@@ -0,0 +1,10 @@
+#ifndef PORTFOLIO_H
+#define PORTFOLIO_H
+
+#include "data_structures.h"
+
+Solution *portfolio_local_search(Graph *g, Fleet *c, Vertice *origin,
+                                 Solution *start, unsigned int n_workers,
+                                 double time_limit);
+
+#endif
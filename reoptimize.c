@@ -0,0 +1,464 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "local_search.h"
+#include "reoptimize.h"
+#include "report.h"
+
+// Passed to uncovered_route when no route takes extra load
+#define NO_ROUTE UINT_MAX
+
+// A solution under repair, as routes of customer ids in the new instance.
+// Routes that lose or gain a customer are marked affected, and only their
+// customers start out active in the local search that follows.
+typedef struct Repair {
+  Graph *g;
+  Fleet *fleet;
+  Vertice *origin;
+  unsigned int n_routes;
+  unsigned int **stops;
+  unsigned int *size;
+  unsigned int *load;
+  bool *affected;
+  bool *placed;
+  unsigned int *pending;
+  unsigned int n_pending;
+  struct RouteLoad *order;
+  unsigned int *counts;
+} Repair;
+
+typedef struct RouteLoad {
+  unsigned int load;
+  unsigned int route;
+} RouteLoad;
+
+// Heaviest first, then by route, the order vehicles are handed out in
+static int compare_route_loads(const void *a, const void *b) {
+  const RouteLoad *ra = a, *rb = b;
+  if (ra->load != rb->load) return ra->load > rb->load ? -1 : 1;
+  return ra->route < rb->route ? -1 : ra->route > rb->route;
+}
+
+void init_instance_delta(InstanceDelta *delta) {
+  delta->removed = NULL;
+  delta->n_removed = 0;
+  delta->changed = NULL;
+  delta->n_changed = 0;
+  delta->fleet_changed = false;
+}
+
+// ===========================================================================
+//                                   ROUTES
+// ===========================================================================
+
+static void init_repair(Repair *rp, Graph *g, Fleet *c, Vertice *origin) {
+  unsigned int n = g->n;
+
+  rp->g = g;
+  rp->fleet = c;
+  rp->origin = origin;
+  rp->n_routes = 0;
+  // Every customer may end up ejected and reinserted on a route of its own
+  rp->stops = calloc(2*n, sizeof(unsigned int *));
+  rp->size = calloc(2*n, sizeof(unsigned int));
+  rp->load = calloc(2*n, sizeof(unsigned int));
+  rp->affected = calloc(2*n, sizeof(bool));
+  rp->placed = calloc(n, sizeof(bool));
+  rp->pending = malloc(n*sizeof(unsigned int));
+  rp->n_pending = 0;
+  rp->order = malloc((2*n + 1)*sizeof(RouteLoad));
+  rp->counts = malloc(c->n_classes*sizeof(unsigned int));
+}
+
+static void destroy_repair(Repair *rp) {
+  unsigned int r;
+  for (r = 0; r < rp->n_routes; r++) {
+    free(rp->stops[r]);
+  }
+  free(rp->stops);
+  free(rp->size);
+  free(rp->load);
+  free(rp->affected);
+  free(rp->placed);
+  free(rp->pending);
+  free(rp->order);
+  free(rp->counts);
+}
+
+static unsigned int open_route(Repair *rp) {
+  unsigned int r = rp->n_routes++;
+  rp->stops[r] = malloc(rp->g->n*sizeof(unsigned int));
+  rp->size[r] = rp->load[r] = 0;
+  rp->affected[r] = false;
+  return r;
+}
+
+static void add_stop(Repair *rp, unsigned int r, unsigned int pos,
+                     unsigned int id) {
+  unsigned int *stops = rp->stops[r];
+  memmove(stops + pos + 1, stops + pos,
+          (rp->size[r] - pos)*sizeof(unsigned int));
+  stops[pos] = id;
+  rp->size[r]++;
+  rp->load[r] += rp->g->v[id]->demand;
+  rp->placed[id] = true;
+}
+
+static unsigned int remove_stop(Repair *rp, unsigned int r, unsigned int pos) {
+  unsigned int *stops = rp->stops[r], id = stops[pos];
+  memmove(stops + pos, stops + pos + 1,
+          (rp->size[r] - pos - 1)*sizeof(unsigned int));
+  rp->size[r]--;
+  rp->load[r] -= rp->g->v[id]->demand;
+  rp->placed[id] = false;
+  return id;
+}
+
+// The vertex before or after position pos of route r, the depot at the ends
+static unsigned int stop_before(Repair *rp, unsigned int r, unsigned int pos) {
+  return pos ? rp->stops[r][pos-1] : rp->origin->id;
+}
+
+static unsigned int stop_at(Repair *rp, unsigned int r, unsigned int pos) {
+  return pos < rp->size[r] ? rp->stops[r][pos] : rp->origin->id;
+}
+
+// Fills rp->order with the non-empty routes heaviest first, with extra load
+// on route, which may be n_routes for a new one. Returns how many there are.
+static unsigned int order_routes(Repair *rp, unsigned int route,
+                                 unsigned int extra) {
+  unsigned int r, n = 0;
+
+  for (r = 0; r < rp->n_routes; r++) {
+    if (!rp->size[r] && r != route) continue;
+    rp->order[n].load = rp->load[r] + (r == route ? extra : 0);
+    rp->order[n++].route = r;
+  }
+  if (route == rp->n_routes) {
+    rp->order[n].load = extra;
+    rp->order[n++].route = route;
+  }
+  qsort(rp->order, n, sizeof(RouteLoad), compare_route_loads);
+  return n;
+}
+
+// Hands vehicles to the routes heaviest first, best fit, as
+// build_solution_from_sequence does once they are written in that order.
+// Returns the first route left without one, or -1 if the fleet covers all.
+static int uncovered_route(Repair *rp, unsigned int route,
+                           unsigned int extra) {
+  unsigned int i, n = order_routes(rp, route, extra);
+  int k;
+
+  memcpy(rp->counts, rp->fleet->count,
+         rp->fleet->n_classes*sizeof(unsigned int));
+  for (i = 0; i < n; i++) {
+    k = fleet_best_fit(rp->fleet, rp->counts, rp->order[i].load);
+    if (k < 0) return rp->order[i].route;
+    rp->counts[k]--;
+  }
+  return -1;
+}
+
+// ===========================================================================
+//                                   REPAIR
+// ===========================================================================
+
+// Returns the new id of the customer old had, or false if it was removed
+static bool map_id(InstanceDelta *delta, unsigned int old, unsigned int *id) {
+  unsigned int i, shift = 0;
+  for (i = 0; i < delta->n_removed; i++) {
+    if (delta->removed[i] == old) return false;
+    if (delta->removed[i] < old) shift++;
+  }
+  *id = old - shift;
+  return true;
+}
+
+// Rebuilds the routes of previous, a sequence of old ids with the depot
+// between routes, in the new instance. Routes that lost a customer or hold
+// one whose demand changed are affected, and customers no route visits wait
+// to be inserted.
+static void load_previous(Repair *rp, unsigned int *previous,
+                          unsigned int length, InstanceDelta *delta) {
+  unsigned int i, j, id, r = 0;
+  bool open = false, lost = false;
+
+  for (i = 0; i < length; i++) {
+    if (!map_id(delta, previous[i], &id) || id >= rp->g->n) {
+      lost = true;
+      continue;
+    }
+    if (id == rp->origin->id) {
+      if (open) rp->affected[r] = lost;
+      open = lost = false;
+      continue;
+    }
+    if (rp->placed[id]) continue;
+    if (!open) {
+      r = open_route(rp);
+      open = true;
+    }
+    add_stop(rp, r, rp->size[r], id);
+  }
+  if (open) rp->affected[r] = lost;
+
+  for (r = 0; r < rp->n_routes; r++) {
+    if (delta->fleet_changed) rp->affected[r] = true;
+    for (i = 0; i < rp->size[r] && !rp->affected[r]; i++) {
+      for (j = 0; j < delta->n_changed; j++) {
+        if (delta->changed[j] == rp->stops[r][i]) rp->affected[r] = true;
+      }
+    }
+  }
+  for (id = 0; id < rp->g->n; id++) {
+    if (id != rp->origin->id && !rp->placed[id]) {
+      rp->pending[rp->n_pending++] = id;
+    }
+  }
+}
+
+// Takes customers off the routes the fleet no longer covers, each time the
+// one whose removal saves the most, until it covers them all
+static void eject_overloads(Repair *rp) {
+  Graph *g = rp->g;
+  unsigned int pos, best_pos, a, v, b;
+  double saving, best;
+  int r;
+
+  while ((r = uncovered_route(rp, NO_ROUTE, 0)) >= 0) {
+    best = -INFINITY;
+    best_pos = 0;
+    for (pos = 0; pos < rp->size[r]; pos++) {
+      a = stop_before(rp, r, pos);
+      v = rp->stops[r][pos];
+      b = stop_at(rp, r, pos + 1);
+      saving = graph_cost(g, a, v) + graph_cost(g, v, b) - graph_cost(g, a, b);
+      if (saving > best) {
+        best = saving;
+        best_pos = pos;
+      }
+    }
+    rp->pending[rp->n_pending++] = remove_stop(rp, r, best_pos);
+    rp->affected[r] = true;
+  }
+}
+
+// Cheapest insertion of the pending customers, largest demand first, each
+// at the position or on the new route that adds the least cost while the
+// fleet still covers the routes. Returns false if one fits nowhere.
+static bool insert_pending(Repair *rp) {
+  Graph *g = rp->g;
+  unsigned int i, r, pos, a, b, v, best_route = 0, best_pos = 0;
+  unsigned int o = rp->origin->id;
+  double added, best;
+
+  for (i = 0; i < rp->n_pending; i++) {
+    rp->order[i].load = g->v[rp->pending[i]]->demand;
+    rp->order[i].route = rp->pending[i];
+  }
+  qsort(rp->order, rp->n_pending, sizeof(RouteLoad), compare_route_loads);
+  for (i = 0; i < rp->n_pending; i++) {
+    rp->pending[i] = rp->order[i].route;
+  }
+
+  for (i = 0; i < rp->n_pending; i++) {
+    v = rp->pending[i];
+    best = INFINITY;
+    for (r = 0; r < rp->n_routes; r++) {
+      if (uncovered_route(rp, r, g->v[v]->demand) >= 0) continue;
+      for (pos = 0; pos <= rp->size[r]; pos++) {
+        a = stop_before(rp, r, pos);
+        b = stop_at(rp, r, pos);
+        added = graph_cost(g, a, v) + graph_cost(g, v, b) - graph_cost(g, a, b);
+        if (added < best) {
+          best = added;
+          best_route = r;
+          best_pos = pos;
+        }
+      }
+    }
+    added = graph_cost(g, o, v) + graph_cost(g, v, o);
+    if (added < best &&
+        uncovered_route(rp, rp->n_routes, g->v[v]->demand) < 0) {
+      best = added;
+      best_route = rp->n_routes;
+      best_pos = 0;
+    }
+    if (best == INFINITY) return false;
+    if (best_route == rp->n_routes) open_route(rp);
+    add_stop(rp, best_route, best_pos, v);
+    rp->affected[best_route] = true;
+  }
+  rp->n_pending = 0;
+  return true;
+}
+
+// Writes the routes heaviest first, followed by a depot for each vehicle
+// left, up to one per route, so the local search can open new routes
+static Solution *repaired_solution(Repair *rp) {
+  unsigned int i, j, r, length = 1, n = order_routes(rp, NO_ROUTE, 0);
+  unsigned int n_spare = rp->fleet->n_vehicles - n;
+  Vertice **sequence;
+  Solution *s;
+
+  if (n_spare > n) n_spare = n;
+  sequence = malloc((rp->g->n + n + n_spare + 1)*sizeof(Vertice *));
+  sequence[0] = rp->origin;
+  for (i = 0; i < n; i++) {
+    r = rp->order[i].route;
+    for (j = 0; j < rp->size[r]; j++) {
+      sequence[length++] = rp->g->v[rp->stops[r][j]];
+    }
+    sequence[length++] = rp->origin;
+  }
+  for (i = 0; i < n_spare; i++) {
+    sequence[length++] = rp->origin;
+  }
+
+  s = malloc(sizeof(Solution));
+  init_solution(s, length - 1);
+  if (!build_solution_from_sequence(s, sequence, rp->g, rp->fleet,
+                                    rp->origin)) {
+    destroy_solution(s);
+    s = NULL;
+  }
+  free(sequence);
+  return s;
+}
+
+// ===========================================================================
+//                               RE-OPTIMISATION
+// ===========================================================================
+
+// Re-optimises previous, a sequence of length old ids with the depot before,
+// between and after routes, for the instance delta describes. Removed
+// customers are dropped, routes the fleet no longer covers give up their
+// costliest customers, and these and the new customers go in by cheapest
+// insertion. A descent from the customers of the affected routes follows,
+// or iterated local search with a time limit, and with exact, a branch and
+// bound search pruning against the result. Returns NULL if the repair finds
+// no room for a customer.
+Solution *reoptimize_routes(Graph *g, Fleet *c, Vertice *origin,
+                            unsigned int *previous, unsigned int length,
+                            InstanceDelta *delta, int n_iter,
+                            double time_limit, bool exact, SearchOptions *o) {
+  unsigned int r, i, n_affected = 0;
+  Repair rp;
+  Solution *s = NULL, *warm_start;
+  SearchOptions defaults;
+  LocalSearch *ls;
+
+  init_repair(&rp, g, c, origin);
+  load_previous(&rp, previous, length, delta);
+  eject_overloads(&rp);
+  if (insert_pending(&rp)) {
+    s = repaired_solution(&rp);
+  }
+  if (!s) {
+    destroy_repair(&rp);
+    return NULL;
+  }
+  log_message(LOG_INFO, "Repaired solution\n\n");
+  log_solution(LOG_INFO, s);
+
+  ls = malloc(sizeof(LocalSearch));
+  init_local_search(ls, g, c, origin, s);
+  memset(ls->active, false, g->n*sizeof(bool));
+  for (r = 0; r < rp.n_routes; r++) {
+    if (!rp.affected[r]) continue;
+    n_affected++;
+    for (i = 0; i < rp.size[r]; i++) {
+      ls->active[rp.stops[r][i]] = true;
+    }
+  }
+  log_message(LOG_INFO, "Local search from %u affected routes\n\n",
+              n_affected);
+  if (time_limit > 0) {
+    s = iterated_local_search(ls, s, time_limit);
+  }
+  else {
+    s = local_search_descent(ls, s);
+  }
+  destroy_local_search(ls);
+  destroy_repair(&rp);
+
+  if (exact) {
+    if (!o) {
+      init_search_options(&defaults);
+      o = &defaults;
+    }
+    warm_start = o->warm_start;
+    o->warm_start = s;
+    s = branch_bound_vrp_solve_with(g, c, origin, n_iter, 0, o);
+    destroy_solution(o->warm_start);
+    o->warm_start = warm_start;
+  }
+  return s;
+}
+
+// Reads the routes of a previous solution, one per line of old ids in the
+// order they are visited. The depot, id 0, and ']' also end a route, so the
+// routes of a JSON record read as they are. Returns the sequence with the
+// depot before, between and after routes, or NULL if the file is unreadable.
+unsigned int *read_previous_routes(const char *path, unsigned int *length) {
+  FILE *file = fopen(path, "r");
+  unsigned int *sequence, size = 64, id = 0;
+  bool digits = false;
+  int c;
+
+  if (!file) return NULL;
+  sequence = malloc(size*sizeof(unsigned int));
+  sequence[0] = 0;
+  *length = 1;
+  do {
+    c = fgetc(file);
+    if (c >= '0' && c <= '9') {
+      id = 10*id + (c - '0');
+      digits = true;
+      continue;
+    }
+    // Room for the id and the depot that may close its route
+    if (*length + 2 > size) {
+      size *= 2;
+      sequence = realloc(sequence, size*sizeof(unsigned int));
+    }
+    if (digits) sequence[(*length)++] = id;
+    if ((c == '\n' || c == ']' || c == EOF) &&
+        sequence[*length - 1] != 0) {
+      sequence[(*length)++] = 0;
+    }
+    id = 0;
+    digits = false;
+  } while (c != EOF);
+  fclose(file);
+  return sequence;
+}
+
+// reoptimize_routes for a Solution found on the old instance, whose depot
+// was previous_origin
+Solution *reoptimize_vrp_solve(Graph *g, Fleet *c, Vertice *origin,
+                               Solution *previous, Vertice *previous_origin,
+                               InstanceDelta *delta, int n_iter,
+                               double time_limit, bool exact,
+                               SearchOptions *o) {
+  unsigned int i, length = previous->n_edges + 1;
+  Vertice **sequence = malloc(length*sizeof(Vertice *));
+  unsigned int *ids = malloc(length*sizeof(unsigned int));
+  Solution *s;
+
+  build_sequence_from_solution(previous, sequence, previous_origin);
+  for (i = 0; i < length; i++) {
+    ids[i] = sequence[i]->id;
+  }
+  s = reoptimize_routes(g, c, origin, ids, length, delta, n_iter, time_limit,
+                        exact, o);
+  free(sequence);
+  free(ids);
+  return s;
+}
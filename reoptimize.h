@@ -0,0 +1,33 @@
+#ifndef REOPTIMIZE_H
+#define REOPTIMIZE_H
+
+#include "branch_bound.h"
+#include "data_structures.h"
+
+// What changed since a solution was found. Vertices keep their order: the
+// removed customers, by their id in the old instance, are gone, and new
+// customers follow the others. Demands and capacities are read from the new
+// instance, changed lists the customers, by their new id, whose demand
+// changed, and fleet_changed says the vehicles did.
+typedef struct InstanceDelta {
+  unsigned int *removed;
+  unsigned int n_removed;
+  unsigned int *changed;
+  unsigned int n_changed;
+  bool fleet_changed;
+} InstanceDelta;
+
+void init_instance_delta(InstanceDelta *delta);
+unsigned int *read_previous_routes(const char *path, unsigned int *length);
+
+Solution *reoptimize_routes(Graph *g, Fleet *c, Vertice *origin,
+                            unsigned int *previous, unsigned int length,
+                            InstanceDelta *delta, int n_iter,
+                            double time_limit, bool exact, SearchOptions *o);
+Solution *reoptimize_vrp_solve(Graph *g, Fleet *c, Vertice *origin,
+                               Solution *previous, Vertice *previous_origin,
+                               InstanceDelta *delta, int n_iter,
+                               double time_limit, bool exact,
+                               SearchOptions *o);
+
+#endif
@@ -0,0 +1,155 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "report.h"
+
+// Set once before solving and only read afterwards
+static LogLevel log_level = LOG_INFO;
+
+// ===========================================================================
+//                                   TIMING
+// ===========================================================================
+
+// Seconds on the monotonic clock since start
+double seconds_since(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec)*1e-9;
+}
+
+// ===========================================================================
+//                                   LOGGING
+// ===========================================================================
+
+void set_log_level(LogLevel level) {
+  log_level = level;
+}
+
+bool log_enabled(LogLevel level) {
+  return level <= log_level;
+}
+
+bool parse_log_level(const char *name, LogLevel *level) {
+  if (!strcmp(name, "none")) {
+    *level = LOG_NONE;
+  }
+  else if (!strcmp(name, "result")) {
+    *level = LOG_RESULT;
+  }
+  else if (!strcmp(name, "info")) {
+    *level = LOG_INFO;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+void log_message(LogLevel level, const char *format, ...) {
+  va_list args;
+  if (!log_enabled(level)) return;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+}
+
+void log_solution(LogLevel level, Solution *s) {
+  if (log_enabled(level)) print_solution(s);
+}
+
+// An incumbent callback for SearchOptions, logging each incumbent and
+// counting them in the IncumbentLog context, if any
+void log_incumbent(Solution *s, double seconds, void *context) {
+  IncumbentLog *log = context;
+  log_solution(LOG_INFO, s);
+  if (log) {
+    log->count++;
+    log->seconds = seconds;
+  }
+}
+
+// ===========================================================================
+//                                 FINAL RECORD
+// ===========================================================================
+
+void write_json_string(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      fprintf(f, "\\%c", *s);
+    }
+    else if ((unsigned char)*s < 0x20) {
+      fprintf(f, "\\u%04x", *s);
+    }
+    else {
+      fputc(*s, f);
+    }
+  }
+  fputc('"', f);
+}
+
+// Writes the routes of s as arrays of customers, depot left out
+static void write_json_routes(FILE *f, Solution *s, Vertice *origin) {
+  Vertice **sequence = malloc((s->n_edges + 1)*sizeof(Vertice *));
+  unsigned int i;
+  bool open = false, first = true;
+
+  build_sequence_from_solution(s, sequence, origin);
+  fputc('[', f);
+  for (i = 1; i <= s->n_edges; i++) {
+    if (sequence[i] == origin) {
+      if (open) fputc(']', f);
+      open = false;
+      continue;
+    }
+    if (!open) {
+      fprintf(f, "%s[", first ? "" : ", ");
+      open = true;
+      first = false;
+    }
+    else {
+      fprintf(f, ", ");
+    }
+    fprintf(f, "%u", sequence[i]->id);
+  }
+  if (open) fputc(']', f);
+  fputc(']', f);
+  free(sequence);
+}
+
+// Writes one JSON object, without a newline: the solution found, or null
+// cost and routes without one, how long it took and what the search did
+void write_result_json(FILE *f, const char *instance, const char *algorithm,
+                       Solution *s, Vertice *origin, double seconds,
+                       SearchStats *stats, IncumbentLog *incumbents) {
+  fprintf(f, "{\"instance\": ");
+  write_json_string(f, instance);
+  fprintf(f, ", \"algorithm\": ");
+  write_json_string(f, algorithm);
+  fprintf(f, ", \"status\": \"%s\"", s ? "solved" : "no_solution");
+  if (s) {
+    fprintf(f, ", \"cost\": %.6f, \"routes\": ", s->cost);
+    write_json_routes(f, s, origin);
+  }
+  else {
+    fprintf(f, ", \"cost\": null, \"routes\": null");
+  }
+  fprintf(f, ", \"seconds\": %.6f", seconds);
+  fprintf(f, ", \"nodes\": %lu, \"pruned_bound\": %lu, "
+          "\"pruned_capacity\": %lu, \"pruned_connectivity\": %lu, "
+          "\"pruned_symmetry\": %lu, \"pruned_dominance\": %lu",
+          stats->nodes, stats->pruned_bound, stats->pruned_capacity,
+          stats->pruned_connectivity, stats->pruned_symmetry,
+          stats->pruned_dominance);
+  fprintf(f, ", \"table_hit_rate\": %.4f", stats->table_probes ?
+          (double)stats->table_hits/stats->table_probes : 0.0);
+  fprintf(f, ", \"incumbents\": %u", incumbents->count);
+  if (incumbents->count) {
+    fprintf(f, ", \"last_incumbent_seconds\": %.6f", incumbents->seconds);
+  }
+  fprintf(f, "}");
+}
@@ -0,0 +1,38 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "branch_bound.h"
+#include "data_structures.h"
+
+// How much a run writes to stdout
+typedef enum LogLevel {
+  LOG_NONE,    // nothing, when a final record or the caller reports instead
+  LOG_RESULT,  // the final solution
+  LOG_INFO     // also incumbents, search summaries and phases
+} LogLevel;
+
+// The incumbents log_incumbent saw
+typedef struct IncumbentLog {
+  unsigned int count;
+  double seconds;
+} IncumbentLog;
+
+double seconds_since(struct timespec *start);
+
+void set_log_level(LogLevel level);
+bool log_enabled(LogLevel level);
+bool parse_log_level(const char *name, LogLevel *level);
+void log_message(LogLevel level, const char *format, ...)
+  __attribute__((format(printf, 2, 3)));
+void log_solution(LogLevel level, Solution *s);
+void log_incumbent(Solution *s, double seconds, void *context);
+
+void write_json_string(FILE *f, const char *s);
+void write_result_json(FILE *f, const char *instance, const char *algorithm,
+                       Solution *s, Vertice *origin, double seconds,
+                       SearchStats *stats, IncumbentLog *incumbents);
+
+#endif
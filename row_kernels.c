@@ -0,0 +1,127 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "row_kernels.h"
+
+// The vector kernels are compiled for their instruction set one function at
+// a time and only run once the CPU says it has it
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ROW_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// ===========================================================================
+//                                  KERNELS
+// ===========================================================================
+
+static bool always_supported(void) {
+  return true;
+}
+
+// Adds vertices i to n to the running sums, one at a time. Every kernel adds
+// in this order, so they all round alike and give the same bounds.
+static inline void add_row_sums(const double *chosen, const double *cheapest,
+                                const double *dearest, unsigned int i,
+                                unsigned int n, double *low, double *up) {
+  for (; i < n; i++) {
+    if (chosen[i]) {
+      *low += chosen[i];
+      *up += chosen[i];
+    }
+    else {
+      *low += cheapest[i];
+      *up += dearest[i];
+    }
+  }
+}
+
+static void scalar_sums(const double *chosen, const double *cheapest,
+                        const double *dearest, unsigned int n, double *lower,
+                        double *upper) {
+  double low = 0, up = 0;
+
+  add_row_sums(chosen, cheapest, dearest, 0, n, &low, &up);
+  *lower = low;
+  *upper = up;
+}
+
+#ifdef ROW_KERNELS_X86
+
+static bool avx2_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+// Adds four vertices' (low, up) pairs to the sums in vertex order, even
+// holding the pairs of the first and third, odd of the second and fourth
+__attribute__((target("avx2")))
+static inline __m128d add_pairs(__m128d sums, __m256d even, __m256d odd) {
+  sums = _mm_add_pd(sums, _mm256_castpd256_pd128(even));
+  sums = _mm_add_pd(sums, _mm256_castpd256_pd128(odd));
+  sums = _mm_add_pd(sums, _mm256_extractf128_pd(even, 1));
+  return _mm_add_pd(sums, _mm256_extractf128_pd(odd, 1));
+}
+
+// Four vertices a step, blending in the chosen costs where they are nonzero.
+// Only the blends are wide: the sums add one vertex at a time, as the scalar
+// kernel does.
+__attribute__((target("avx2")))
+static void avx2_sums(const double *chosen, const double *cheapest,
+                      const double *dearest, unsigned int n, double *lower,
+                      double *upper) {
+  __m256d zero = _mm256_setzero_pd(), c, mask, low, up;
+  __m128d sums = _mm_setzero_pd();
+  unsigned int i;
+  double low_sum, up_sum;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    c = _mm256_loadu_pd(chosen + i);
+    mask = _mm256_cmp_pd(c, zero, _CMP_NEQ_UQ);
+    low = _mm256_blendv_pd(_mm256_loadu_pd(cheapest + i), c, mask);
+    up = _mm256_blendv_pd(_mm256_loadu_pd(dearest + i), c, mask);
+    sums = add_pairs(sums, _mm256_unpacklo_pd(low, up),
+                     _mm256_unpackhi_pd(low, up));
+  }
+  low_sum = _mm_cvtsd_f64(sums);
+  up_sum = _mm_cvtsd_f64(_mm_unpackhi_pd(sums, sums));
+  add_row_sums(chosen, cheapest, dearest, i, n, &low_sum, &up_sum);
+  *lower = low_sum;
+  *upper = up_sum;
+}
+
+#endif
+
+const RowKernel row_kernels[] = {
+  {"scalar", scalar_sums, always_supported},
+#ifdef ROW_KERNELS_X86
+  {"avx2", avx2_sums, avx2_supported},
+#endif
+};
+const unsigned int n_row_kernels = sizeof(row_kernels)/sizeof(row_kernels[0]);
+
+// ===========================================================================
+//                                  DISPATCH
+// ===========================================================================
+
+static _Atomic(RowSumKernel) selected;
+
+const RowKernel *best_row_kernel(void) {
+  unsigned int k = n_row_kernels;
+  while (--k > 0 && !row_kernels[k].supported()) {
+  }
+  return &row_kernels[k];
+}
+
+// Picks the fastest kernel the CPU runs on first use. Threads racing here
+// all store the same one.
+void masked_row_sums(const double *chosen, const double *cheapest,
+                     const double *dearest, unsigned int n, double *lower,
+                     double *upper) {
+  RowSumKernel sums = atomic_load_explicit(&selected, memory_order_relaxed);
+  if (!sums) {
+    sums = best_row_kernel()->masked_sums;
+    atomic_store_explicit(&selected, sums, memory_order_relaxed);
+  }
+  sums(chosen, cheapest, dearest, n, lower, upper);
+}
@@ -0,0 +1,31 @@
+#ifndef ROW_KERNELS_H
+#define ROW_KERNELS_H
+
+#include <stdbool.h>
+
+// Sums over n vertices the cost of each one's chosen out edge where it has
+// one, a nonzero chosen cost, and otherwise of its cheapest allowed out
+// edge into lower and its most expensive one into upper. Every kernel adds
+// the vertices one at a time in the same order, so all of them return the
+// same sums bit for bit, and lower equals upper whenever every vertex has
+// chosen.
+typedef void (*RowSumKernel)(const double *chosen, const double *cheapest,
+                             const double *dearest, unsigned int n,
+                             double *lower, double *upper);
+
+typedef struct RowKernel {
+  const char *name;
+  RowSumKernel masked_sums;
+  bool (*supported)(void);
+} RowKernel;
+
+// The kernels built in, fastest last
+extern const RowKernel row_kernels[];
+extern const unsigned int n_row_kernels;
+
+const RowKernel *best_row_kernel(void);
+void masked_row_sums(const double *chosen, const double *cheapest,
+                     const double *dearest, unsigned int n, double *lower,
+                     double *upper);
+
+#endif
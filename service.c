@@ -0,0 +1,460 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "heuristic.h"
+#include "report.h"
+#include "service.h"
+
+// A service reads jobs, one per line, from stdin or from every connection to
+// its socket: an instance file, the algorithm as main takes it, 0 for branch
+// and bound and 1 for the heuristic, and the iteration count. A pool of
+// workers solves them, each keeping one workspace across its jobs, and each
+// result goes back to where its job came from as a JSON line, in the order
+// jobs finish.
+
+// Where results go. Every job holds a reference, as does the reader of its
+// connection, and the last one out closes a socket connection.
+typedef struct Client {
+  FILE *out;
+  pthread_mutex_t lock;
+  unsigned int refs;
+  bool owned;
+} Client;
+
+typedef struct Job {
+  unsigned long id;
+  char *instance;
+  bool heuristic;
+  int n_iter;
+  Client *client;
+  struct Job *next;
+} Job;
+
+typedef struct JobQueue {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  Job *head, *tail;
+  bool closed;
+} JobQueue;
+
+typedef struct Connection {
+  struct Service *service;
+  int fd;
+  struct Connection *next;
+} Connection;
+
+typedef struct Service {
+  ServiceOptions *options;
+  JobQueue queue;
+  atomic_ulong next_id;
+  // Open socket connections, which shutdown waits out
+  pthread_mutex_t lock;
+  pthread_cond_t closed;
+  Connection *connections;
+} Service;
+
+static volatile sig_atomic_t stopping = 0;
+
+// ===========================================================================
+//                                   CLIENTS
+// ===========================================================================
+
+static Client *new_client(FILE *out, bool owned) {
+  Client *client = malloc(sizeof(Client));
+  client->out = out;
+  pthread_mutex_init(&client->lock, NULL);
+  client->refs = 1;
+  client->owned = owned;
+  return client;
+}
+
+static void hold_client(Client *client) {
+  pthread_mutex_lock(&client->lock);
+  client->refs++;
+  pthread_mutex_unlock(&client->lock);
+}
+
+static void release_client(Client *client) {
+  unsigned int refs;
+
+  pthread_mutex_lock(&client->lock);
+  refs = --client->refs;
+  pthread_mutex_unlock(&client->lock);
+  if (refs) return;
+  if (client->owned) {
+    fclose(client->out);
+  }
+  else {
+    fflush(client->out);
+  }
+  pthread_mutex_destroy(&client->lock);
+  free(client);
+}
+
+static void send_error(Client *client, unsigned long id,
+                       const char *instance, const char *error) {
+  pthread_mutex_lock(&client->lock);
+  fprintf(client->out, "{\"job\": %lu, \"instance\": ", id);
+  write_json_string(client->out, instance ? instance : "");
+  fprintf(client->out, ", \"error\": \"%s\"}\n", error);
+  fflush(client->out);
+  pthread_mutex_unlock(&client->lock);
+}
+
+// ===========================================================================
+//                                  JOB QUEUE
+// ===========================================================================
+
+static void init_job_queue(JobQueue *q) {
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->ready, NULL);
+  q->head = q->tail = NULL;
+  q->closed = false;
+}
+
+static void destroy_job_queue(JobQueue *q) {
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->ready);
+}
+
+static void destroy_job(Job *job) {
+  release_client(job->client);
+  free(job->instance);
+  free(job);
+}
+
+static void push_job(JobQueue *q, Job *job) {
+  job->next = NULL;
+  pthread_mutex_lock(&q->lock);
+  if (q->closed) {
+    pthread_mutex_unlock(&q->lock);
+    destroy_job(job);
+    return;
+  }
+  if (q->tail) {
+    q->tail->next = job;
+  }
+  else {
+    q->head = job;
+  }
+  q->tail = job;
+  pthread_cond_signal(&q->ready);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// Waits for a job, returning NULL once the queue is closed and empty
+static Job *pop_job(JobQueue *q) {
+  Job *job;
+
+  pthread_mutex_lock(&q->lock);
+  while (!q->head && !q->closed) {
+    pthread_cond_wait(&q->ready, &q->lock);
+  }
+  job = q->head;
+  if (job) {
+    q->head = job->next;
+    if (!q->head) q->tail = NULL;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return job;
+}
+
+static void close_job_queue(JobQueue *q) {
+  pthread_mutex_lock(&q->lock);
+  q->closed = true;
+  pthread_cond_broadcast(&q->ready);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// Parses a job line into a queued job for client. Blank lines and comments
+// are skipped, and malformed lines answered with an error.
+static void read_job(Service *sv, char *line, Client *client) {
+  char *instance, *algorithm, *n_iter, *rest;
+  unsigned long id;
+  Job *job;
+
+  instance = strtok_r(line, " \t\r\n", &rest);
+  if (!instance || instance[0] == '#') return;
+  algorithm = strtok_r(NULL, " \t\r\n", &rest);
+  n_iter = strtok_r(NULL, " \t\r\n", &rest);
+  id = atomic_fetch_add(&sv->next_id, 1);
+  if (!algorithm || (strcmp(algorithm, "0") && strcmp(algorithm, "1"))) {
+    send_error(client, id, instance, "expected an algorithm, 0 or 1");
+    return;
+  }
+
+  job = malloc(sizeof(Job));
+  job->id = id;
+  job->instance = strdup(instance);
+  job->heuristic = algorithm[0] == '1';
+  job->n_iter = n_iter ? atoi(n_iter) : 0;
+  job->client = client;
+  hold_client(client);
+  push_job(&sv->queue, job);
+}
+
+static void read_jobs(Service *sv, FILE *in, Client *client) {
+  size_t bufsize = 256;
+  char *buffer = malloc(bufsize);
+
+  while (!stopping && getline(&buffer, &bufsize, in) > 0) {
+    read_job(sv, buffer, client);
+  }
+  free(buffer);
+}
+
+// ===========================================================================
+//                                   WORKERS
+// ===========================================================================
+
+static void solve_job(Service *sv, Job *job, Workspace **workspace) {
+  ServiceOptions *so = sv->options;
+  Client *client = job->client;
+  Instance *inst = malloc(sizeof(Instance));
+  SearchOptions o = so->search;
+  SearchStats stats = {0};
+  IncumbentLog incumbents = {0, 0};
+  Solution *s;
+  Vertice *origin;
+  struct timespec start;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (!read_instance(inst, job->instance)) {
+    free(inst);
+    send_error(client, job->id, job->instance, "could not read instance");
+    return;
+  }
+  origin = inst->vertices[0];
+  if (!*workspace) {
+    *workspace = malloc(sizeof(Workspace));
+    init_workspace(*workspace, inst->g, inst->vehicles);
+  }
+  o.workspace = *workspace;
+  o.stats = &stats;
+  o.on_incumbent = log_incumbent;
+  o.incumbent_context = &incumbents;
+  o.warm_start = so->construct ?
+                 so->construct(inst->g, inst->vehicles, origin) : NULL;
+
+  if (job->heuristic) {
+    s = heuristic_vrp_solve(inst->g, inst->vehicles, origin, job->n_iter,
+                            so->time_limit, &o);
+  }
+  else {
+    s = branch_bound_vrp_solve_with(inst->g, inst->vehicles, origin,
+                                    job->n_iter, 0, &o);
+  }
+
+  pthread_mutex_lock(&client->lock);
+  fprintf(client->out, "{\"job\": %lu, \"result\": ", job->id);
+  write_result_json(client->out, job->instance,
+                    job->heuristic ? "heuristic" : "branch_bound", s, origin,
+                    seconds_since(&start), &stats, &incumbents);
+  fprintf(client->out, "}\n");
+  fflush(client->out);
+  pthread_mutex_unlock(&client->lock);
+
+  destroy_solution(s);
+  destroy_solution(o.warm_start);
+  destroy_instance(inst);
+}
+
+static void *service_worker(void *arg) {
+  Service *sv = arg;
+  Workspace *workspace = NULL;
+  Job *job;
+
+  while ((job = pop_job(&sv->queue))) {
+    solve_job(sv, job, &workspace);
+    destroy_job(job);
+  }
+  destroy_workspace(workspace);
+  return NULL;
+}
+
+// ===========================================================================
+//                                   SOCKETS
+// ===========================================================================
+
+static void stop_service(int sig) {
+  (void)sig;
+  stopping = 1;
+}
+
+static void drop_connection(Connection *conn) {
+  Service *sv = conn->service;
+  Connection **it;
+
+  pthread_mutex_lock(&sv->lock);
+  for (it = &sv->connections; *it != conn; it = &(*it)->next);
+  *it = conn->next;
+  pthread_cond_broadcast(&sv->closed);
+  pthread_mutex_unlock(&sv->lock);
+  free(conn);
+}
+
+// Reads the jobs of one connection. Results go out on a duplicate of its
+// descriptor, which stays open until the last of its jobs is answered.
+static void *connection_run(void *arg) {
+  Connection *conn = arg;
+  FILE *in = fdopen(conn->fd, "r"), *out;
+  int fd = dup(conn->fd);
+  Client *client;
+
+  out = fd >= 0 ? fdopen(fd, "w") : NULL;
+  if (!in || !out) {
+    if (in) fclose(in);
+    else close(conn->fd);
+    if (out) fclose(out);
+    else if (fd >= 0) close(fd);
+    drop_connection(conn);
+    return NULL;
+  }
+  client = new_client(out, true);
+  read_jobs(conn->service, in, client);
+  release_client(client);
+  // The descriptor is closed under the lock shutdown takes to reach it
+  pthread_mutex_lock(&conn->service->lock);
+  fclose(in);
+  conn->fd = -1;
+  pthread_mutex_unlock(&conn->service->lock);
+  drop_connection(conn);
+  return NULL;
+}
+
+// Stops reading from every connection and waits for their readers to finish
+static void close_connections(Service *sv) {
+  Connection *conn;
+
+  pthread_mutex_lock(&sv->lock);
+  for (conn = sv->connections; conn; conn = conn->next) {
+    if (conn->fd >= 0) shutdown(conn->fd, SHUT_RD);
+  }
+  while (sv->connections) {
+    pthread_cond_wait(&sv->closed, &sv->lock);
+  }
+  pthread_mutex_unlock(&sv->lock);
+}
+
+// Accepts connections until SIGINT or SIGTERM, reading each on a thread
+// of its own
+static bool serve_socket(Service *sv, const char *path) {
+  struct sockaddr_un addr;
+  struct sigaction action;
+  Connection *conn;
+  pthread_t thread;
+  int listener, fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) return false;
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) return false;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(listener, 16)) {
+    close(listener);
+    return false;
+  }
+
+  // No SA_RESTART, so that a signal interrupts accept
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop_service;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  while (!stopping) {
+    fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;
+    }
+    conn = malloc(sizeof(Connection));
+    conn->service = sv;
+    conn->fd = fd;
+    pthread_mutex_lock(&sv->lock);
+    conn->next = sv->connections;
+    sv->connections = conn;
+    pthread_mutex_unlock(&sv->lock);
+    if (pthread_create(&thread, NULL, connection_run, conn)) {
+      close(fd);
+      conn->fd = -1;
+      drop_connection(conn);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  close(listener);
+  unlink(path);
+  close_connections(sv);
+  return true;
+}
+
+// ===========================================================================
+//                                   SERVICE
+// ===========================================================================
+
+void init_service_options(ServiceOptions *o) {
+  long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  init_search_options(&o->search);
+  o->construct = construct_solution;
+  o->n_workers = n_cpus > 0 ? n_cpus : 1;
+  o->time_limit = 0;
+  o->socket_path = NULL;
+}
+
+// Serves jobs until stdin ends or, on a socket, until a signal, then waits
+// for the jobs already read. Returns false if the socket could not be set up.
+bool run_service(ServiceOptions *o) {
+  Service sv;
+  pthread_t *workers;
+  Client *client;
+  unsigned int i, n_workers = o->n_workers ? o->n_workers : 1;
+  bool ok = true;
+
+  // Results are the only output, and a client may hang up at any time
+  set_log_level(LOG_NONE);
+  signal(SIGPIPE, SIG_IGN);
+  sv.options = o;
+  init_job_queue(&sv.queue);
+  atomic_init(&sv.next_id, 0);
+  pthread_mutex_init(&sv.lock, NULL);
+  pthread_cond_init(&sv.closed, NULL);
+  sv.connections = NULL;
+
+  workers = calloc(n_workers, sizeof(pthread_t));
+  for (i = 0; i < n_workers; i++) {
+    pthread_create(&workers[i], NULL, service_worker, &sv);
+  }
+
+  if (o->socket_path) {
+    ok = serve_socket(&sv, o->socket_path);
+  }
+  else {
+    client = new_client(stdout, false);
+    read_jobs(&sv, stdin, client);
+    release_client(client);
+  }
+
+  close_job_queue(&sv.queue);
+  for (i = 0; i < n_workers; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+  destroy_job_queue(&sv.queue);
+  pthread_mutex_destroy(&sv.lock);
+  pthread_cond_destroy(&sv.closed);
+
+  return ok;
+}
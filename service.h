@@ -0,0 +1,22 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include "branch_bound.h"
+#include "construction.h"
+
+// How a service solves its jobs: the search options and warm start each job
+// starts from, how many jobs are solved side by side, the local search budget
+// of heuristic jobs and where jobs come from
+typedef struct ServiceOptions {
+  SearchOptions search;
+  Constructor construct;
+  unsigned int n_workers;
+  double time_limit;
+  // A UNIX socket to listen on, or NULL to read jobs from stdin
+  const char *socket_path;
+} ServiceOptions;
+
+void init_service_options(ServiceOptions *o);
+bool run_service(ServiceOptions *o);
+
+#endif
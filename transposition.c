@@ -0,0 +1,141 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "transposition.h"
+
+// Entries per bucket, probed together
+#define BUCKET_SIZE 4
+// Buckets a table starts with, so that short searches stay cheap
+#define INITIAL_BUCKETS 1024
+
+// ===========================================================================
+//                                 STATE KEYS
+// ===========================================================================
+
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static uint64_t *random_keys(unsigned int n, uint64_t *state) {
+  uint64_t *keys = malloc(n*sizeof(uint64_t));
+  unsigned int i;
+  for (i = 0; i < n; i++) {
+    keys[i] = splitmix64(state);
+  }
+  return keys;
+}
+
+void init_state_keys(StateKeys *k, unsigned int n, uint64_t seed) {
+  k->n = n;
+  k->visit = random_keys(n, &seed);
+  k->depot = random_keys(n, &seed);
+  k->head = random_keys(n, &seed);
+  k->current = random_keys(n, &seed);
+  k->first = random_keys(n, &seed);
+}
+
+void destroy_state_keys(StateKeys *k) {
+  free(k->visit);
+  free(k->depot);
+  free(k->head);
+  free(k->current);
+  free(k->first);
+}
+
+// Folds the load of the route being built and the vehicles left into key.
+// The result is never zero, which marks an empty table entry.
+uint64_t mix_state_key(uint64_t key, unsigned int load,
+                       unsigned int *vehicles, unsigned int n_classes) {
+  uint64_t state = key ^ ((uint64_t)load << 32);
+  unsigned int i;
+  for (i = 0; i < n_classes; i++) {
+    state = splitmix64(&state) ^ vehicles[i];
+  }
+  return splitmix64(&state) | 1;
+}
+
+// ===========================================================================
+//                                   TABLE
+// ===========================================================================
+
+// Caps the table at the largest power of two buckets within bytes
+void init_transposition_table(TranspositionTable *t, size_t bytes) {
+  size_t bucket = BUCKET_SIZE*sizeof(TableEntry);
+  t->max_buckets = 1;
+  while (2*t->max_buckets*bucket <= bytes) {
+    t->max_buckets *= 2;
+  }
+  t->n_buckets = t->max_buckets < INITIAL_BUCKETS ? t->max_buckets :
+                 INITIAL_BUCKETS;
+  t->entries = calloc(t->n_buckets*BUCKET_SIZE, sizeof(TableEntry));
+  t->used = 0;
+}
+
+// Doubles the buckets. Each one splits in two on the next bit of its keys,
+// so its entries always fit.
+static void grow_table(TranspositionTable *t) {
+  size_t i, n_buckets = 2*t->n_buckets;
+  TableEntry *entries = calloc(n_buckets*BUCKET_SIZE, sizeof(TableEntry));
+  TableEntry *e, *slot;
+
+  for (i = 0; i < t->n_buckets*BUCKET_SIZE; i++) {
+    e = t->entries + i;
+    if (!e->key) continue;
+    slot = entries + (e->key & (n_buckets - 1))*BUCKET_SIZE;
+    while (slot->key) {
+      slot++;
+    }
+    *slot = *e;
+  }
+  free(t->entries);
+  t->entries = entries;
+  t->n_buckets = n_buckets;
+}
+
+void destroy_transposition_table(TranspositionTable *t) {
+  free(t->entries);
+}
+
+// Looks key up, returning whether a state reached at no more than cost is
+// there. Otherwise records cost for key, in its own entry or in place of
+// the least useful one of the bucket. *hit says whether key was found.
+bool table_dominated(TranspositionTable *t, uint64_t key, double cost,
+                     unsigned int depth, bool *hit) {
+  TableEntry *bucket, *victim, *e;
+  unsigned int i;
+
+  bucket = t->entries + (key & (t->n_buckets - 1))*BUCKET_SIZE;
+  victim = bucket;
+  *hit = false;
+  for (i = 0; i < BUCKET_SIZE; i++) {
+    e = bucket + i;
+    if (!e->key) {
+      if (victim->key) victim = e;
+      continue;
+    }
+    if (e->key == key) {
+      *hit = true;
+      if (e->cost <= cost) return true;
+      e->cost = cost;
+      e->depth = depth;
+      return false;
+    }
+    if (victim->key && e->depth > victim->depth) {
+      victim = e;
+    }
+  }
+  if (!victim->key) t->used++;
+  victim->key = key;
+  victim->cost = cost;
+  victim->depth = depth;
+  if (4*t->used > 3*t->n_buckets*BUCKET_SIZE &&
+      t->n_buckets < t->max_buckets) {
+    grow_table(t);
+  }
+  return false;
+}
@@ -0,0 +1,48 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Random keys whose XOR over the parts of a search state makes its Zobrist
+// hash: the customers visited, the depot edges and the edges of the current
+// vertex excluded towards unvisited customers, the current vertex and the
+// first customer of the route being built
+typedef struct StateKeys {
+  unsigned int n;
+  uint64_t *visit;
+  uint64_t *depot;
+  uint64_t *head;
+  uint64_t *current;
+  uint64_t *first;
+} StateKeys;
+
+void init_state_keys(StateKeys *k, unsigned int n, uint64_t seed);
+void destroy_state_keys(StateKeys *k);
+uint64_t mix_state_key(uint64_t key, unsigned int load,
+                       unsigned int *vehicles, unsigned int n_classes);
+
+typedef struct TableEntry {
+  uint64_t key;
+  double cost;
+  unsigned int depth;
+} TableEntry;
+
+// The least cost a search reached each state with, in buckets of a few
+// entries, a zero key marking an empty one. The table starts small and
+// doubles as it fills, up to max_buckets; from then on a full bucket gives
+// up its deepest entry, whose subtree was the smallest.
+typedef struct TranspositionTable {
+  TableEntry *entries;
+  size_t n_buckets;
+  size_t max_buckets;
+  size_t used;
+} TranspositionTable;
+
+void init_transposition_table(TranspositionTable *t, size_t bytes);
+void destroy_transposition_table(TranspositionTable *t);
+bool table_dominated(TranspositionTable *t, uint64_t key, double cost,
+                     unsigned int depth, bool *hit);
+
+#endif